@@ -15,8 +15,16 @@
 #include <type_traits>
 #include <algorithm>
 #include <fstream>
+#include <memory>
+#include <atomic>
+#include <stdexcept>
 #include "board.h"
 #include "action.h"
+#include "bitboard.h"
+#include "solver.h"
+#include "mcts.h"
+#include "topology.h"
+#include "library.h"
 #include <omp.h>
 #include <thread>
 
@@ -36,6 +44,11 @@ public:
 	virtual action take_action(const board& b) { return action(); }
 	virtual bool check_for_win(const board& b) { return false; }
 
+	/**
+	 * the visits of the root moves in the last take_action, as pairs of cell and visits, for the episode records
+	 */
+	virtual std::vector<std::pair<int, int> > root_visits() const { return {}; }
+
 public:
 	virtual std::string property(const std::string& key) const { return meta.at(key); }
 	virtual void notify(const std::string& msg) { meta[msg.substr(0, msg.find('='))] = { msg.substr(msg.find('=') + 1) }; }
@@ -65,265 +78,464 @@ protected:
 	std::default_random_engine engine;
 };
 
-class node{
-	public:
-		board state;
-		board::piece_type who;
-		int win = 0;
-		int visit = 0;
-		action::place move;
-		node* parent = nullptr;
-		std::vector<node*> children;
-		~node(){};
-};
-
+/**
+ * the player searching by Monte-Carlo tree search, see mcts.h
+ *
+ * the search policies are chosen by selection=ucb-rave|ucb, playout=random|lgrf|network and backup=rave|plain,
+ * and take_action dispatches to the matching instance of the search template once per move
+ * the side to move is taken from the state, so that role=both serves both colors in self-play,
+ * and with reuse=1 the tree of each thread is kept across plies until the episode ends
+ * with sync=N, the root-parallel threads exchange their shallow statistics every N simulations
+ * search=tree-mcts runs thread= threads on one shared tree instead of a tree for each thread
+ * huge_pages=off|auto|explicit chooses the pages behind the node pools of the process, see node_pool
+ * thread=auto runs a thread per physical core, cpus= restricts the threads to a CPU list such as 0-3,8,
+ * and pin=compact|spread pins each thread to a CPU of its own during a search, see cpu_topology; session=k,
+ * given by --listen to the k-th session, starts the placement k * thread= CPUs further
+ * max_mem= caps the trees of the player at that many MiB, see mcts::prune
+ * compact=N lays out the trees again every N simulations and before searching a kept tree, see compact_tree
+ * besides take_action, a move can be searched in the background by start, watched by poll and cut short by stop
+ * multipv=k reports the principal variations of the k most visited moves, see analyze, and with multipv_visits=N
+ * the search keeps at least k moves at N visits in each tree
+ * cache=MiB keeps the statistics of the searched positions for the whole process, and seeds the new nodes with
+ * at most cache_prior= visits of them (half of simulation= by default), see value_cache, where the first cache=
+ * of the process fixes the size; cache_file= loads the cache when the player is created and saves it when the
+ * player is destroyed
+ * load_tree= starts the search of a new root from its tree in a library file, see tree_library, and save_tree=
+ * adds the tree of every searched position within the first save_plies= plies to a library, at most save_nodes=
+ * nodes of it
+ * record_visits=1 keeps the visits of the root moves of every search for the episode records, see root_visits
+ * playout=network evaluates the leaves by the network of network= instead of playing them out, in batches of
+ * at most batch= positions that wait at most batch_wait= microseconds, on batch_threads= threads, see inference_service
+ */
 class MCTS_player : public random_agent {
 public:
-	std::vector<action::place> space, white_space, black_space;
+	std::vector<action::place> space;
 	MCTS_player(const std::string& args = "") : random_agent("name=random role=unknown " + args),
-		space(board::size_x * board::size_y),white_space(board::size_x * board::size_y),
-		black_space(board::size_x * board::size_y), who(board::empty) {
+		space(board::size_x * board::size_y), who(board::empty) {
 		if (meta.find("search") != meta.end()) search = (std::string)meta["search"];
-		if (meta.find("simulation") != meta.end()) simulation_count = (int)meta["simulation"];
-		if (meta.find("thread") != meta.end()) thread_num = (int)meta["thread"];
+		if (meta.find("simulation") != meta.end()) options.simulation_count = (int)meta["simulation"];
+		if (meta.find("cpus") != meta.end()) cpus = cpu_topology::parse(meta["cpus"]);
+		cpu_topology topology(cpus);
+		if (meta.find("thread") != meta.end()) {
+			if ((std::string)meta["thread"] == "auto") thread_num = std::max(1, topology.cores());
+			else thread_num = (int)meta["thread"];
+		}
+		if (meta.find("pin") != meta.end()) placement = topology.order(meta["pin"]);
+		if (meta.find("session") != meta.end() && placement.size()) {
+			int shift = (int)meta["session"] * thread_num % int(placement.size());
+			std::rotate(placement.begin(), placement.begin() + shift, placement.end());
+		}
+		if (meta.find("root") != meta.end()) options.root_search = (std::string)meta["root"];
+		if (meta.find("candidates") != meta.end()) options.candidate_num = (int)meta["candidates"];
+		if (meta.find("truncate") != meta.end()) options.truncate_margin = (int)meta["truncate"];
+		if (meta.find("tactics") != meta.end()) options.tactics_budget = (int)meta["tactics"];
+		if (meta.find("selection") != meta.end()) selection_policy = (std::string)meta["selection"];
+		if (meta.find("playout") != meta.end()) playout_policy = (std::string)meta["playout"];
+		if (meta.find("backup") != meta.end()) backup_policy = (std::string)meta["backup"];
+		if (meta.find("endgame") != meta.end()) endgame_size = (int)meta["endgame"];
+		if (endgame_size < 0 || endgame_size > region_table::max_region)
+			throw std::invalid_argument("invalid endgame: " + std::to_string(endgame_size));
+		if (meta.find("region_db") != meta.end()) solver.load(meta["region_db"]);
+		if (meta.find("reuse") != meta.end()) reuse = (int)meta["reuse"];
+		if (meta.find("sync") != meta.end()) options.sync_interval = (int)meta["sync"];
+		if (meta.find("max_mem") != meta.end()) max_mem = (double)meta["max_mem"];
+		if (meta.find("compact") != meta.end()) options.compact_interval = (int)meta["compact"];
+		if (meta.find("multipv") != meta.end()) options.multipv = (int)meta["multipv"];
+		if (meta.find("multipv_visits") != meta.end()) options.multipv_visits = (int)meta["multipv_visits"];
+		if (meta.find("huge_pages") != meta.end()) node_pool::configure(meta["huge_pages"]);
+		if (meta.find("cache") != meta.end()) {
+			value_cache::global().configure((double)meta["cache"]);
+			options.cache_prior = std::max(1, options.simulation_count / 2);
+		}
+		if (meta.find("cache_prior") != meta.end()) options.cache_prior = (int)meta["cache_prior"];
+		if (meta.find("cache_file") != meta.end()) {
+			cache_path = (std::string)meta["cache_file"];
+			value_cache::global().load(cache_path);
+		}
+		if (!value_cache::global().enabled()) options.cache_prior = 0;
+		if (meta.find("load_tree") != meta.end()) library.open(meta["load_tree"]);
+		if (meta.find("save_tree") != meta.end()) save_path = (std::string)meta["save_tree"];
+		if (meta.find("save_nodes") != meta.end()) save_nodes = (int)meta["save_nodes"];
+		if (meta.find("save_plies") != meta.end()) save_plies = (int)meta["save_plies"];
+		if (meta.find("record_visits") != meta.end()) record_visits = (int)meta["record_visits"];
+		if (meta.find("network") != meta.end()) inference_service::global().load(meta["network"]);
+		if (meta.find("batch") != meta.end() || meta.find("batch_wait") != meta.end() || meta.find("batch_threads") != meta.end()) {
+			int batch = meta.find("batch") != meta.end() ? (int)meta["batch"] : 64;
+			int wait = meta.find("batch_wait") != meta.end() ? (int)meta["batch_wait"] : 1000;
+			int threads = meta.find("batch_threads") != meta.end() ? (int)meta["batch_threads"] : 0;
+			inference_service::global().configure(batch, wait, threads);
+		}
 		if (role() == "black") who = board::black;
 		if (role() == "white") who = board::white;
 		for (size_t i = 0; i < space.size(); i++)
 			space[i] = action::place(i, who);
-		for (size_t i = 0; i < white_space.size(); ++i)
-			white_space[i] = action::place(i, board::white);
-		for (size_t i = 0; i < black_space.size(); ++i)
-			black_space[i] = action::place(i, board::black);
 	}
 
+	virtual ~MCTS_player() {
+		stop();
+		clear_trees();
+		if (cache_path.size()) value_cache::global().save(cache_path);
+	}
+
+	virtual void open_episode(const std::string& flag = "") {
+		clear_trees();
+		clock = 0;
+	}
+	virtual void close_episode(const std::string& flag = "") { clear_trees(); }
+
 	virtual action take_action(const board& state) {
-		if (search == "p-mcts"){
-			omp_set_num_threads(thread_num);
-			std::vector<node*> roots(thread_num);
+		return search_move(state);
+	}
+
+	virtual std::vector<std::pair<int, int> > root_visits() const { return visits; }
+
+	/**
+	 * the state of a search started by start: the best move so far, the statistics of the root children
+	 * by visits with a principal variation, and whether the search is over
+	 */
+	struct analysis {
+		action::place best;
+		search_control::snapshot root;
+		bool finished;
+	};
+
+	/**
+	 * search the move of state on a thread of its own, and return at once; with infinite, the search
+	 * ignores simulation= and runs until stop
+	 */
+	void start(const board& state, bool infinite = false) {
+		stop();
+		control.reset(thread_num, infinite);
+		active = &control;
+		done = false;
+		worker = std::thread([this, state]() {
+			result = search_move(state);
+			done.store(true, std::memory_order_release);
+		});
+	}
+
+	analysis poll() const {
+		analysis a;
+		a.root = control.collect();
+		a.finished = done.load(std::memory_order_acquire);
+		if (a.finished) a.best = result;
+		else if (a.root.children.size()) a.best = a.root.children[0].move;
+		return a;
+	}
+
+	/**
+	 * ask the search to stop after the simulations in progress, wait for it, and return its move,
+	 * or an empty action if there is no search
+	 */
+	action stop() {
+		if (!worker.joinable()) return action();
+		control.stop = true;
+		worker.join();
+		active = nullptr;
+		return result;
+	}
+
+	/**
+	 * search state on the calling thread with the budget of simulation=, or of the given simulations,
+	 * and return the top k moves by visits with their values and principal variations, or the multipv= moves if k is 0
+	 */
+	analysis analyze(const board& state, int k = 0, int simulations = 0) {
+		stop();
+		int multipv = options.multipv, budget = options.simulation_count;
+		if (k > 0) options.multipv = k;
+		if (simulations > 0) options.simulation_count = simulations;
+		control.reset(thread_num);
+		active = &control;
+		result = search_move(state);
+		done = true;
+		active = nullptr;
+		options.multipv = multipv;
+		options.simulation_count = budget;
+		analysis a = poll();
+		a.root.children.resize(std::min<size_t>(a.root.children.size(), k > 0 ? k : multipv));
+		return a;
+	}
+
+	bool searching() const { return worker.joinable() && !done.load(std::memory_order_acquire); }
+
+	/**
+	 * search the move of state with the threads given by the scheduler, see search_scheduler, and add the time
+	 * to the clock of the game; without a scheduler, the search runs thread= threads
+	 */
+	action::place search_move(const board& state) {
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		int threads = 0;
+		if (search == "p-mcts" || search == "tree-mcts") threads = search_scheduler::global().acquire(thread_num, clock);
+		action::place move = search_tree(state, threads ? threads : thread_num);
+		search_scheduler::global().release(threads);
+		clock += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		return move;
+	}
+
+	/**
+	 * search the move of state on the given number of threads
+	 */
+	action::place search_tree(const board& state, int threads) {
+		board::piece_type turn = state.info().who_take_turns;
+		visits.clear();
+		if (endgame_size) {
+			solver.trim(1 << 22);
+			action move = solver.solve(bitboard(state), endgame_size);
+			if (move.type() == action::place::type) return move;
+		}
+		if (search == "p-mcts" || search == "tree-mcts") {
+			omp_set_num_threads(threads);
+			while (int(contexts.size()) < threads) {
+				contexts.emplace_back();
+				contexts.back().engine.seed(engine());
+			}
+			for (int i = 0; i < threads; i++) {
+				contexts[i].control = active;
+				contexts[i].slot = i;
+			}
+		}
+		if (search == "tree-mcts") {
+			if (shared_root) shared_root = find_subtree(shared_root, bitboard(state));
+			if (shared_root && options.compact_interval) compact_tree(shared_root, options.compact_visits);
+			if (!shared_root) shared_root = library.find<shared_node>(bitboard(state));
+			if (!shared_root) {
+				shared_root = new shared_node;
+				shared_root->state = bitboard(state);
+				shared_root->who = (turn == board::white ? board::black : board::white);
+				if (options.cache_prior) seed_node(shared_root, value_cache::key(shared_root->state, shared_root->who), options.cache_prior);
+			}
+			std::atomic<long> shared_nodes(0);
+			if (max_mem > 0) {
+				options.max_nodes = long(max_mem * (1 << 20) / node_bytes<shared_node>());
+				shared_nodes = tree_size(shared_root);
+			}
+			for (int i = 0; i < threads; i++) contexts[i].shared_nodes = &shared_nodes;
 
 			#pragma omp parallel for
-			for(int i = 0; i < thread_num; i++) {
-				roots[i] = new node;
-				roots[i]->state = state;
-				roots[i]->who = (who == board::white ? board::black : board::white);
-				int total_node = 0;
-				Expansion(roots[i], total_node);
-				board::piece_type winner;
-				run_MCTS(roots[i], winner, total_node);	
-			}		
-
-			for (int idx = 1; idx < thread_num; idx++) {
-				for(size_t i = 0; i < roots[0]->children.size() ; i++) {
-					roots[0]->children[i]->visit += roots[idx]->children[i]->visit;
-				}
+			for(int i = 0; i < threads; i++) {
+				cpu_topology::binding bound(thread_cpus(i));
+				run_search(shared_root, contexts[i]);
+			}
+			if (options.cache_prior) remember_tree(shared_root, options.cache_visits);
+			if (saving(state)) tree_library::save(save_path, shared_root, save_nodes);
+
+			std::vector<node> merged(shared_root->children.size());
+			for(size_t i = 0; i < merged.size(); i++) {
+				merged[i].move = shared_root->children[i]->move;
+				merged[i].visit = shared_root->children[i]->visit;
+				merged[i].win = shared_root->children[i]->win;
+			}
+			action::place best_action = get_action(merged);
+			if (!reuse) clear_trees();
+			return best_action;
+		}
+		else if (search == "p-mcts") {
+			if (max_mem > 0) options.max_nodes = long(max_mem * (1 << 20) / node_bytes<node>() / threads);
+			if (int(roots.size()) != threads) {
+				clear_trees();
+				roots.assign(threads, nullptr);
+			}
+			std::unique_ptr<exchange_buffer> exchange;
+			if (options.sync_interval > 0 && threads > 1) exchange.reset(new exchange_buffer(threads));
+			for (int i = 0; i < threads; i++) {
+				contexts[i].exchange = exchange.get();
 			}
 
-			action best_action = get_action(roots[0]);
 			#pragma omp parallel for
-			for(int i = 0; i < thread_num; i++) {
-				delete_tree(roots[i]);
-				free(roots[i]);
+			for(int i = 0; i < threads; i++) {
+				cpu_topology::binding bound(thread_cpus(i));
+				if (roots[i]) roots[i] = find_subtree(roots[i], bitboard(state));
+				if (roots[i] && options.compact_interval) compact_tree(roots[i], options.compact_visits);
+				if (!roots[i]) roots[i] = library.find<node>(bitboard(state));
+				if (!roots[i]) {
+					roots[i] = new node;
+					roots[i]->state = bitboard(state);
+					roots[i]->who = (turn == board::white ? board::black : board::white);
+					if (options.cache_prior) seed_node(roots[i], value_cache::key(roots[i]->state, roots[i]->who), options.cache_prior);
+				}
+				if (max_mem > 0) contexts[i].nodes = tree_size(roots[i]);
+				run_search(roots[i], contexts[i]);
+				if (options.cache_prior) remember_tree(roots[i], options.cache_visits);
+			}
+
+			// the children of every root are expanded in the same order, so they can be merged by index
+			// the statistics received from the other threads are left out, as they are counted in their own trees
+			std::vector<node> merged(roots[0]->children.size());
+			for (int idx = 0; idx < threads; idx++) {
+				search_context& ctx = contexts[idx];
+				for(size_t i = 0; i < merged.size(); i++) {
+					node* child = roots[idx]->children[i];
+					merged[i].move = child->move;
+					merged[i].visit += child->visit;
+					merged[i].win += child->win;
+					if (ctx.exchange) {
+						merged[i].visit -= ctx.received[child->move.position().i].visit;
+						merged[i].win -= ctx.received[child->move.position().i].win;
+					}
+				}
+				ctx.exchange = nullptr;
 			}
+			if (saving(state)) tree_library::save(save_path, roots[0], save_nodes);
+
+			action::place best_action = get_action(merged);
+			if (!reuse) clear_trees();
 			return best_action;
 		}
 		else {
 			std::shuffle(space.begin(), space.end(), engine);
-			for (const action::place& move : space) {
+			for (const action::place& place : space) {
+				action::place move(place.position(), turn);
 				board after = state;
 				if (move.apply(after) == board::legal)
 					return move;
 			}
-			return action();
+			return action::place();
 		}
 	}
 
-	node* Selection(node* n) {			
-		node* cur = n;
-		while(!cur->children.empty()) {
-			double max_value = 0;
-			int select_idx = 0;
-			for(size_t i = 0; i < cur->children.size(); ++i) {
-				double ucb = get_ucb_value(cur->children[i]);
-				if(max_value < ucb) {
-					max_value = ucb;
-					select_idx = i;
-				}
-			}
-			cur = cur->children[select_idx];
-		}
-		return cur;
+	/**
+	 * whether the tree of state is added to the library of save_tree=, which is so for the openings alone,
+	 * since the later positions of a game hardly come again
+	 */
+	bool saving(const board& state) const {
+		return save_path.size() && bitboard::cells - bitboard::count(bitboard(state).empty()) <= save_plies;
 	}
 
-	double get_ucb_value(node* cur) {					
-		if(cur->visit == 0 || rave_map[cur->move].first == 0) return 1e8;
-		double constant = std::sqrt(2);
-		double beta = std::sqrt((double) simulation_count/(double)(3 * count + simulation_count));
-		double win_rate = (double) cur->win / (double) cur->visit;
-		if (cur->who == who) win_rate = 1 - win_rate;
-		double rave_win_rate = (double) rave_map[cur->move].second / (double) rave_map[cur->move].first;
-		double exploitation = (1 - beta) * win_rate + beta * rave_win_rate;
-		double exploration = sqrt(log((double)cur->parent->visit)/cur->visit);
-		return exploitation + constant * exploration;
+	/**
+	 * the CPUs of the search thread i, its CPU by pin=, or those of cpus=, or none to leave it unbound
+	 */
+	std::vector<int> thread_cpus(int i) const {
+		if (placement.size()) return { placement[i % placement.size()] };
+		return cpus;
 	}
-	
-	void Expansion(node* parent_node, int& total_node) {
-		action::place child_move;
-		if (parent_node->who == board::black) {
-			for(const action::place& child_move : white_space) {
-				board after = parent_node->state;
-				if (child_move.apply(after) == board::legal) {
-					node* child_node = new node;
-					child_node->state = after;
-					child_node->parent = parent_node;
-					child_node->move = child_move;
-					child_node->who = board::white;
-					parent_node->children.emplace_back(child_node);
-					if (rave_map.find(child_node->move) == rave_map.end()) 
-						rave_map.insert(std::make_pair(child_node->move, std::make_pair(0, 0)));
-				}
-			}
-		}
-		else if (parent_node->who == board::white) {
-			for(const action::place& child_move : black_space) {
-				board after = parent_node->state;
-				if (child_move.apply(after) == board::legal) {
-					node* child_node = new node;
-					child_node->state = after;
-					child_node->parent = parent_node;
-					child_node->move = child_move;
-					child_node->who = board::black;
-					parent_node->children.emplace_back(child_node);
-					if (rave_map.find(child_node->move) == rave_map.end()) 
-						rave_map.insert(std::make_pair(child_node->move, std::make_pair(0, 0)));
-				}
-			}
-		}	
-		total_node += parent_node->children.size();
-	}				
-	
-	board::piece_type Simulation(node* root) {
-		bool terminal = false;
-		board state = root->state;
-		board::piece_type who = root->who;
-        std::vector<board::point> emptyPoint;
-        for (int i = 0; i < board::size_x * board::size_y; i++) {
-            board::point move(i);
-            if (state[move.x][move.y] == board::empty)
-                emptyPoint.push_back(move);
-        }
-        int size = emptyPoint.size();
-		while(terminal == false) {
-			terminal = true;
-			who = (who == board::white ? board::black : board::white);
-			if (who == board::black) {
-				int i = 0;
-				board after = state;
-				while(i < size){
-					std::uniform_int_distribution<int> uniform(i, size-1);
-					int randomIndex = uniform(engine);
-					if(after.place(emptyPoint[randomIndex]) == board::legal){
-						state.place(emptyPoint[randomIndex]);
-						std::swap(emptyPoint[randomIndex], emptyPoint[size-1]);
-						size--;
-						terminal = false;
-						break;		
-					}
-					else{
-						std::swap(emptyPoint[randomIndex], emptyPoint[i]);
-                		i++;
-					}					
-				}
-			}
-			else if (who == board::white) {
-				int i = 0;
-				board after = state;
-				while(i < size){
-					std::uniform_int_distribution<int> uniform(i, size-1);
-					int randomIndex = uniform(engine);
-					if(after.place(emptyPoint[randomIndex]) == board::legal){
-						state.place(emptyPoint[randomIndex]);
-						std::swap(emptyPoint[randomIndex], emptyPoint[size-1]);
-						size--;
-						terminal = false;
-						break;		
-					}
-					else{
-						std::swap(emptyPoint[randomIndex], emptyPoint[i]);
-                		i++;
-					}					
-				}
-			}
-		}
-		return (who == board::white ? board::black : board::white);
+
+	/**
+	 * run the search instance of the configured policies from root with the context of a thread
+	 */
+	template<class node_type>
+	void run_search(node_type* root, search_context& ctx) {
+		inference_service::client client(playout_policy == "network");
+		if (selection_policy == "ucb") run_search<node_type, ucb_selection>(root, ctx);
+		else run_search<node_type, ucb_rave_selection>(root, ctx);
 	}
-	
-	void BackPropagation(node* root, node* cur, board::piece_type winner) {
-		while(cur != root) {
-			cur->visit += 1;
-			rave_map[cur->move].first += 1;
-			if(winner != root->who){
-				cur->win += 1;
-				rave_map[cur->move].second += 1;
-			}
-			cur = cur->parent;
-		}
-		root->visit += 1;
-		rave_map[root->move].first += 1;
-		if(winner != root->who) {
-			root->win += 1;
-			rave_map[root->move].first += 1;
-		}
+	template<class node_type, class selection>
+	void run_search(node_type* root, search_context& ctx) {
+		if (playout_policy == "lgrf") run_search<node_type, selection, lgrf_playout>(root, ctx);
+		else if (playout_policy == "network") run_search<node_type, selection, network_playout>(root, ctx);
+		else run_search<node_type, selection, random_playout>(root, ctx);
 	}
-	
-	void run_MCTS(node* root, board::piece_type winner, int total_node){
-		for (int i = 0; i < simulation_count; i++) {
-			node* best_node = Selection(root);
-			Expansion(best_node, total_node);	
-			if(best_node->children.size() != 0){
-				std::shuffle(best_node->children.begin(), best_node->children.end(), engine);
-				winner = Simulation(best_node->children[0]);
-				BackPropagation(root, best_node->children[0], winner);
-			}
-			else{
-				winner = Simulation(best_node);
-				BackPropagation(root, best_node, winner);
-			}
-			count += 1;
-		}
+	template<class node_type, class selection, class playout>
+	void run_search(node_type* root, search_context& ctx) {
+		if (backup_policy == "plain") mcts<node_type, selection, playout, plain_backup>(ctx, options).run_MCTS(root);
+		else mcts<node_type, selection, playout, rave_backup>(ctx, options).run_MCTS(root);
 	}
-	
-	action get_action(node* root) {					
+
+	action::place get_action(const std::vector<node>& children) {
+		if (record_visits)
+			for (const node& child : children) visits.emplace_back(child.move.position().i, child.visit);
 		int child_idx = -1;
 		int max_visit = 0;
-		for(size_t i = 0; i < root->children.size(); ++i) {
-			if(root->children[i]->visit > max_visit) {
-				max_visit = root->children[i]->visit;
+		double max_rate = 0;
+		for(size_t i = 0; i < children.size(); ++i) {
+			const node& child = children[i];
+			double rate = (double) child.win / std::max(child.visit, 1);
+			if(child.visit > max_visit || (child.visit == max_visit && rate > max_rate)) {
+				max_visit = child.visit;
+				max_rate = rate;
 				child_idx = i;
 			}
 		}
-		if(child_idx != -1) return root->children[child_idx]->move;
-		return action();
+		if(child_idx != -1) return children[child_idx].move;
+		return action::place();
 	}
-	
-	void delete_tree(node* node) {
-		if(node->children.empty() == false) {
-			for(size_t i = 0; i < node->children.size(); ++i) {
-				delete_tree(node->children[i]);
-				if(node->children[i] != NULL)
-					free(node->children[i]);
-			}
-			node->children.clear();
+
+	/**
+	 * find the node of state among the expanded nodes at most two plies below root,
+	 * detach it as the new root and free the rest of the tree, or free the whole tree
+	 * and return nullptr if the state is not there
+	 */
+	template<class node_type>
+	node_type* find_subtree(node_type* root, const bitboard& state) {
+		node_type* found = nullptr;
+		if (root->state == state) return root;
+		for (node_type* child : root->children) {
+			if (child->state == state) found = child;
+			for (node_type* grandchild : child->children)
+				if (grandchild->state == state) found = grandchild;
+			if (found) break;
+		}
+		if (found) {
+			std::vector<node_type*>& siblings = found->parent->children;
+			siblings.erase(std::find(siblings.begin(), siblings.end(), found));
+			found->parent = nullptr;
+		}
+		delete_tree(root);
+		return found;
+	}
+
+	template<class node_type>
+	static long tree_size(const node_type* root) {
+		long size = 1;
+		for (const node_type* child : root->children) size += tree_size(child);
+		return size;
+	}
+
+	/**
+	 * the memory that a node takes, with its pointer in the children of its parent and the allocator overhead
+	 */
+	template<class node_type>
+	static size_t node_bytes() { return sizeof(node_type) + sizeof(node_type*) + 16; }
+
+	void clear_trees() {
+		for (node*& root : roots) {
+			if (root) delete_tree(root);
+			root = nullptr;
 		}
-		return;
+		if (shared_root) delete_tree(shared_root);
+		shared_root = nullptr;
+	}
+
+	/**
+	 * free the tree, the children in reverse order, so that the node pool hands out the blocks of
+	 * siblings in ascending order again when they are reused
+	 */
+	template<class node_type>
+	void delete_tree(node_type* root) {
+		for (auto it = root->children.rbegin(); it != root->children.rend(); ++it)
+			delete_tree(*it);
+		delete root;
 	}
 
 private:
 	std::string search;
-	int simulation_count = 0;
-	int count = 0;
 	int thread_num = 4;
+	std::vector<int> cpus;
+	std::vector<int> placement;
 	board::piece_type who;
-	std::map<action::place, std::pair<int, int> > rave_map;
+	search_options options;
+	std::string selection_policy = "ucb-rave";
+	std::string playout_policy = "random";
+	std::string backup_policy = "rave";
+	std::vector<search_context> contexts;
+	std::vector<node*> roots;
+	shared_node* shared_root = nullptr;
+	int reuse = 0;
+	double max_mem = 0;
+	std::string cache_path;
+	tree_library library;
+	std::string save_path;
+	size_t save_nodes = 100000;
+	int save_plies = 10;
+	int record_visits = 0;
+	std::vector<std::pair<int, int> > visits; // of the root moves in the last search, with record_visits=
+	double clock = 0; // the seconds spent in search_move in the current episode
+	int endgame_size = 0;
+	region_solver solver;
+	search_control control;
+	search_control* active = nullptr;
+	std::thread worker;
+	std::atomic<bool> done{false};
+	action::place result;
 	double time_management[36] = {	5.0, 5.0, 5.0, 5.0, 5.0, 5.0,
 									6.0, 5.0, 5.0, 5.0, 5.0, 5.0,
 									9.0, 9.0, 9.0, 9.0, 9.0, 9.0,
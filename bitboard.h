@@ -0,0 +1,182 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * bitboard.h: Bit-parallel view of the board for fast playouts and evaluation
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "board.h"
+
+/**
+ * the board stored as bit sets, one bit per cell in the 1-d order of board::point,
+ * i.e., bit (i) is the cell [x][y] with i = x * size_y + y
+ *
+ * all operations work on whole bit sets at once, so that the legal moves of both sides
+ * can be generated with a handful of shifts and a flood fill for each block
+ * the hollow cells are neither empty nor stones, so they never count as liberties
+ */
+class bitboard {
+public:
+	typedef unsigned __int128 bits;
+	enum size { cells = board::size_x * board::size_y };
+
+public:
+	bitboard() : stone{0, 0}, space(0), who(board::black) {}
+	bitboard(const board& b) : stone{0, 0}, space(0), who(b.info().who_take_turns) {
+		for (int i = 0; i < cells; i++) {
+			board::cell c = b(i);
+			if (c == board::empty) space |= bit(i);
+			else if (c == board::black) stone[0] |= bit(i);
+			else if (c == board::white) stone[1] |= bit(i);
+		}
+	}
+	/**
+	 * the initial board with the given stones, and who to move
+	 */
+	bitboard(bits black, bits white, board::piece_type who) : stone{black, white}, space(0), who(who) {
+		static const bits initial = bitboard(board()).empty();
+		space = initial & ~(black | white);
+	}
+
+public:
+	bits empty() const { return space; }
+	bits stones(unsigned who) const { return stone[who - 1]; }
+	board::piece_type take_turns() const { return who; }
+
+	bool operator ==(const bitboard& b) const {
+		return stone[0] == b.stone[0] && stone[1] == b.stone[1] && space == b.space && who == b.who;
+	}
+	bool operator !=(const bitboard& b) const { return !(*this == b); }
+
+	/**
+	 * place a stone of who at cell i, the move should be legal
+	 */
+	void place(int i, unsigned who) {
+		stone[who - 1] |= bit(i);
+		space &= ~bit(i);
+		this->who = static_cast<board::piece_type>(3u - who);
+	}
+
+	/**
+	 * generate the legal moves of both sides
+	 *
+	 * a move of who at an empty cell is legal iff
+	 * (1) the cell has an empty neighbor, or it touches a block of who with at least two liberties, and
+	 * (2) the cell is not the last liberty of an opponent block
+	 */
+	void legal_moves(bits& black, bits& white) const {
+		bits safe[2] = {0, 0}, atari[2] = {0, 0};
+		for (int c = 0; c < 2; c++) {
+			for (bits rest = stone[c]; rest; ) {
+				bits blk = block(rest & -rest, stone[c]);
+				bits lib = neighbors(blk) & space;
+				rest &= ~blk;
+				if (lib & (lib - 1)) safe[c] |= blk;
+				else atari[c] |= lib;
+			}
+		}
+		bits open = neighbors(space);
+		black = space & (open | neighbors(safe[0])) & ~atari[1];
+		white = space & (open | neighbors(safe[1])) & ~atari[0];
+	}
+	bits legal_moves(unsigned who) const {
+		bits black, white;
+		legal_moves(black, white);
+		return who == board::black ? black : white;
+	}
+
+	/**
+	 * static mobility evaluation from the view of the side to move, given the legal moves own and opp of
+	 * the side to move and of the other side, as by legal_moves
+	 *
+	 * private points are the legal moves that the other side cannot play,
+	 * contested points are the legal moves of both sides
+	 * return the number of own private points minus the number of opponent private points
+	 */
+	static int evaluate(bits own, bits opp, int* contested = nullptr) {
+		if (contested) *contested = count(own & opp);
+		return count(own & ~opp) - count(opp & ~own);
+	}
+
+	/**
+	 * split the empty cells within mask into independent regions
+	 *
+	 * two empty cells are in the same region if they are adjacent, or if they are liberties of the
+	 * same block, so that a move in one region never changes the legal moves of another region
+	 */
+	std::vector<bits> regions(bits mask = full()) const {
+		std::vector<bits> libs;
+		for (int c = 0; c < 2; c++) {
+			for (bits rest = stone[c]; rest; ) {
+				bits blk = block(rest & -rest, stone[c]);
+				libs.push_back(neighbors(blk) & space);
+				rest &= ~blk;
+			}
+		}
+		std::vector<bits> res;
+		for (bits rest = space & mask; rest; ) {
+			bits region = rest & -rest;
+			for (bits last = 0; last != region; ) {
+				last = region = block(region, space);
+				for (bits lib : libs) if (lib & region) region |= lib;
+			}
+			res.push_back(region);
+			rest &= ~region;
+		}
+		return res;
+	}
+
+public:
+	static bits bit(int i) { return bits(1) << i; }
+	static bits full() { return (bits(1) << cells) - 1; }
+
+	static bits neighbors(bits b) {
+		static const bits bottom = column_mask(0), top = column_mask(board::size_y - 1);
+		return (((b & ~top) << 1) | ((b & ~bottom) >> 1) | (b << board::size_y) | (b >> board::size_y)) & full();
+	}
+
+	/**
+	 * flood fill from seed within mask, i.e., the block containing seed
+	 */
+	static bits block(bits seed, bits mask) {
+		for (bits next = seed; ; seed = next) {
+			next = (seed | neighbors(seed)) & mask;
+			if (next == seed) return seed;
+		}
+	}
+
+	static int count(bits b) {
+		return __builtin_popcountll(uint64_t(b)) + __builtin_popcountll(uint64_t(b >> 64));
+	}
+
+	static int lowest(bits b) {
+		return uint64_t(b) ? __builtin_ctzll(uint64_t(b)) : 64 + __builtin_ctzll(uint64_t(b >> 64));
+	}
+
+	/**
+	 * return the index of the n-th (0-based) set bit of b
+	 */
+	static int select(bits b, int n) {
+		int low = __builtin_popcountll(uint64_t(b));
+		int base = n < low ? 0 : 64;
+		uint64_t half = n < low ? uint64_t(b) : uint64_t(b >> 64);
+		for (n -= n < low ? 0 : low; n; n--) half &= half - 1;
+		return base + __builtin_ctzll(half);
+	}
+
+private:
+	static bits column_mask(int y) {
+		bits mask = 0;
+		for (int x = 0; x < board::size_x; x++) mask |= bit(x * board::size_y + y);
+		return mask;
+	}
+
+	bits stone[2];
+	bits space;
+	board::piece_type who;
+};
@@ -0,0 +1,213 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * cache.h: Process-wide cache of the values of searched positions
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "board.h"
+
+/**
+ * the backed-up visits and wins of positions, shared by all players and threads of the process
+ *
+ * a position is keyed by the smallest of its Zobrist hashes under the 8 symmetries of the board, with the stones
+ * labeled by whether they belong to the side to move, so that the mirrored, rotated and color-swapped positions
+ * share an entry; the wins are those of the player who has just moved, as in the nodes of the search
+ * the table has a fixed size, given by the first cache= of the process, and is split into buckets of 4 entries,
+ * where a new position replaces the least visited entry of its bucket; the buckets are guarded by a lock for each
+ * shard of them, and are never reallocated, so that players may be created while others search
+ */
+class value_cache {
+public:
+	struct entry {
+		uint64_t key;
+		int visit;
+		int win;
+	};
+	enum { ways = 4, shards = 256 };
+
+	static value_cache& global() {
+		static value_cache cache;
+		return cache;
+	}
+
+	/**
+	 * fix the size of the table to the given MiB, where a size of 0 turns the cache off, and return whether it is so;
+	 * a later size other than the first is ignored with a warning
+	 */
+	bool configure(double mib) {
+		size_t size = size_t(mib * (1 << 20)) / sizeof(bucket);
+		std::lock_guard<std::mutex> guard(configuring);
+		if (!fixed) {
+			buckets.assign(size, bucket());
+			count.store(size, std::memory_order_release);
+			fixed = true;
+		}
+		if (size == count.load(std::memory_order_relaxed)) return true;
+		std::cerr << "cache=" << mib << " is ignored, since the value cache is already fixed to another size" << std::endl;
+		return false;
+	}
+	bool enabled() const { return count.load(std::memory_order_acquire); }
+
+	bool find(uint64_t key, int& visit, int& win) const {
+		size_t n = count.load(std::memory_order_acquire);
+		if (!n) return false;
+		const bucket& b = buckets[key % n];
+		std::lock_guard<std::mutex> guard(lock(key, n));
+		for (const entry& e : b.slot) {
+			if (e.key != key) continue;
+			visit = e.visit;
+			win = e.win;
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * keep the statistics of a position, unless the entry already has more visits
+	 */
+	void store(uint64_t key, int visit, int win) {
+		size_t n = count.load(std::memory_order_acquire);
+		if (!n) return;
+		bucket& b = buckets[key % n];
+		std::lock_guard<std::mutex> guard(lock(key, n));
+		entry* victim = &b.slot[0];
+		for (entry& e : b.slot) {
+			if (e.key == key) {
+				victim = &e;
+				break;
+			}
+			if (e.visit < victim->visit) victim = &e;
+		}
+		if (victim->key == key && victim->visit > visit) return;
+		*victim = { key, visit, win };
+	}
+
+	/**
+	 * save the entries to a file, or load them from one into the current table
+	 * the entries are written to a file of a unique name, which is renamed over path, one save at a time, so that
+	 * the savers never interleave and the readers see either the old file or the new one as a whole
+	 */
+	bool save(const std::string& path) const {
+		std::lock_guard<std::mutex> serial(saving);
+		std::string temp = path + "." + std::to_string(getpid()) + "." + std::to_string(syscall(SYS_gettid));
+		std::ofstream out(temp, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) return false;
+		size_t n = count.load(std::memory_order_acquire);
+		for (size_t i = 0; i < n; i++) {
+			std::lock_guard<std::mutex> guard(lock(i, n));
+			for (const entry& e : buckets[i].slot)
+				if (e.key) out.write(reinterpret_cast<const char*>(&e), sizeof(e));
+		}
+		out.close();
+		if (out.good() && std::rename(temp.c_str(), path.c_str()) == 0) return true;
+		std::remove(temp.c_str());
+		return false;
+	}
+	bool load(const std::string& path) {
+		std::ifstream in(path, std::ios::in | std::ios::binary);
+		if (!in.is_open()) return false;
+		for (entry e; in.read(reinterpret_cast<char*>(&e), sizeof(e)); ) store(e.key, e.visit, e.win);
+		return true;
+	}
+
+public:
+	/**
+	 * the hashes of a position under each symmetry, where the stones of mover, who has just moved, are labeled 1
+	 * and those of the side to move 0
+	 */
+	template<class board_type>
+	static void keys(const board_type& state, unsigned mover, uint64_t (&k)[8]) {
+		const table& z = zobrist();
+		for (int s = 0; s < 8; s++) k[s] = 0;
+		for (int label = 0; label < 2; label++) {
+			for (auto rest = state.stones(label ? mover : 3u - mover); rest; rest &= rest - 1) {
+				int i = board_type::lowest(rest);
+				for (int s = 0; s < 8; s++) k[s] ^= z.hash[s][label][i];
+			}
+		}
+	}
+
+	/**
+	 * the key of the position after mover plays at cell i, from the hashes of the position before the move
+	 * as given by keys with the same mover
+	 */
+	static uint64_t key(const uint64_t (&k)[8], int i) {
+		const table& z = zobrist();
+		uint64_t min = -1ull;
+		for (int s = 0; s < 8; s++) min = std::min(min, k[s] ^ z.hash[s][1][i]);
+		return min ? min : 1;
+	}
+
+	/**
+	 * the key of a position, where mover has just moved
+	 */
+	template<class board_type>
+	static uint64_t key(const board_type& state, unsigned mover) {
+		uint64_t k[8];
+		keys(state, mover, k);
+		uint64_t min = *std::min_element(k, k + 8);
+		return min ? min : 1;
+	}
+
+private:
+	struct alignas(64) bucket {
+		entry slot[ways] = {};
+	};
+
+	/**
+	 * the random numbers of each label and cell under each symmetry, fixed so that the saved keys stay valid
+	 */
+	struct table {
+		uint64_t hash[8][2][board::size_x * board::size_y];
+		table() {
+			uint64_t seed = 0x9e3779b97f4a7c15ull;
+			uint64_t base[2][board::size_x * board::size_y];
+			for (auto& label : base) for (uint64_t& h : label) { // splitmix64
+				uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+				z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+				z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+				h = z ^ (z >> 31);
+			}
+			const int n = board::size_x - 1;
+			for (int s = 0; s < 8; s++) {
+				for (int x = 0; x < board::size_x; x++) {
+					for (int y = 0; y < board::size_y; y++) {
+						int u = (s & 1) ? n - x : x, v = (s & 2) ? n - y : y;
+						if (s & 4) std::swap(u, v);
+						for (int label = 0; label < 2; label++)
+							hash[s][label][x * board::size_y + y] = base[label][u * board::size_y + v];
+					}
+				}
+			}
+		}
+	};
+	static const table& zobrist() {
+		static const table z;
+		return z;
+	}
+
+	std::mutex& lock(uint64_t key, size_t n) const { return locks[key % n % shards]; }
+
+	std::vector<bucket> buckets;
+	std::atomic<size_t> count{0}; // the buckets, set once with the table
+	bool fixed = false;
+	mutable std::mutex locks[shards];
+	std::mutex configuring;
+	mutable std::mutex saving;
+};
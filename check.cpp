@@ -0,0 +1,237 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * check.cpp: Regression checks of the search, built with the address sanitizer and run by make check
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#include <iostream>
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#include <random>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include "board.h"
+#include "bitboard.h"
+#include "mcts.h"
+#include "solver.h"
+#include "library.h"
+#include "cache.h"
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+	std::cout << (ok ? "ok: " : "FAILED: ") << what << std::endl;
+	if (!ok) failures++;
+}
+
+template<class node_type>
+static long count_nodes(node_type* root) {
+	long n = 1;
+	for (node_type* child : root->children) n += count_nodes(child);
+	return n;
+}
+
+/**
+ * prune a tree seeded by cache=, where a node at depth 3 has more visits than its parent at depth 2,
+ * so that the parent is pruned first and the node is freed with it, and must not be touched again
+ * the target of no nodes cannot be reached, so that only the top two plies are left
+ */
+static void check_prune_seeded() {
+	typedef mcts<node, ucb_selection, random_playout, plain_backup> search;
+	search_context ctx;
+	search_options opt;
+	search tree(ctx, opt);
+
+	node* root = new node;
+	root->state = bitboard(board());
+	root->who = board::white;
+	ctx.nodes = 1;
+	tree.Expansion(root);
+	node* depth1 = root->children.front();
+	tree.Expansion(depth1);
+	node* depth2 = depth1->children.front();
+	tree.Expansion(depth2);
+	node* depth3 = depth2->children.front();
+	tree.Expansion(depth3);
+	depth2->visit = 5;
+	depth3->visit = 50; // seeded from the value cache
+	long top = 1 + root->children.size() + depth1->children.size();
+
+	opt.max_nodes = top;
+	tree.prune(root, 0);
+	expect(depth2->children.empty() && !depth2->expanded(), "prune the node at depth 2 below a node with more visits");
+	expect(ctx.nodes == count_nodes(root), "count the nodes left after pruning");
+	expect(ctx.nodes == top, "keep the top two plies when the target cannot be reached");
+	search::free_tree(root);
+}
+
+/**
+ * switch on the node pools after nodes have been allocated by the global allocator, which must be refused,
+ * so that those nodes are not freed into a pool
+ */
+static void check_pool_fixed() {
+	delete new node;
+	expect(!node_pool::configure("auto") && !node_pool::enabled(), "keep the page mode of the first allocation");
+	expect(node_pool::configure("off"), "accept the page mode already in use");
+}
+
+/**
+ * allocate a block on a thread that exits, and then on another thread, which must adopt the pool of the first
+ * rather than map a chunk of its own
+ */
+static void check_pool_adopted() {
+	node_pool* first = nullptr;
+	node_pool* second = nullptr;
+	std::thread([&]() { node_pool::release((first = &node_pool::local<48>())->allocate()); }).join();
+	size_t reserved = node_pool::reserved();
+	std::thread([&]() { node_pool::release((second = &node_pool::local<48>())->allocate()); }).join();
+	expect(first == second && node_pool::reserved() == reserved, "adopt the pool of a thread that has exited");
+}
+
+/**
+ * save the regions solved along random games as a table, and solve positions along other games by the table,
+ * which must agree with solving them from scratch
+ */
+static void check_region_table() {
+	const std::string path = "nogo-check-regions.bin";
+	std::default_random_engine engine(1);
+	region_solver builder;
+	for (int i = 0; i < 20; i++) builder.explore(bitboard(board()), 8, engine);
+	expect(builder.save(path, 8), "save a region table");
+	region_solver table, plain;
+	expect(table.load(path), "load a region table");
+	bool agree = true;
+	int solved = 0;
+	for (int i = 0; i < 20; i++) {
+		bitboard b = bitboard(board());
+		for (bitboard::bits moves; (moves = b.legal_moves(b.take_turns())); ) {
+			bool small = true;
+			for (bitboard::bits part : b.regions()) small = small && bitboard::count(part) <= 8;
+			if (small) {
+				agree = agree && table.wins(b) == plain.wins(b);
+				solved++;
+			}
+			std::uniform_int_distribution<int> uniform(0, bitboard::count(moves) - 1);
+			b.place(bitboard::select(moves, uniform(engine)), b.take_turns());
+		}
+	}
+	expect(agree && solved > 0, "solve positions by a region table as from scratch");
+	std::remove(path.c_str());
+}
+
+/**
+ * save a tree to a library, and build it back from the file, from a copy of the file whose root lost its children,
+ * so that the groups below them have no parent, from a copy whose first child is played by the wrong color,
+ * and from a copy cut in the middle of the tree
+ */
+static void check_library_malformed() {
+	typedef mcts<node, ucb_selection, random_playout, plain_backup> search;
+	const std::string path = "nogo-check-trees.bin", broken = "nogo-check-broken.bin";
+	search_context ctx;
+	search_options opt;
+	search tree(ctx, opt);
+	node* root = new node;
+	root->state = bitboard(board());
+	root->who = board::white;
+	root->visit = 2;
+	tree.Expansion(root);
+	root->children.front()->visit = 1;
+	tree.Expansion(root->children.front());
+	std::remove(path.c_str());
+	expect(tree_library::save(path, root, 1000), "save a tree to a library");
+
+	tree_library library;
+	node* found = library.open(path) ? library.find<node>(root->state) : nullptr;
+	expect(found && count_nodes(found) == count_nodes(root), "build a saved tree");
+	if (found) search::free_tree(found);
+	library.close();
+
+	std::ifstream in(path, std::ios::binary);
+	std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	const size_t first = sizeof(tree_library::header) + sizeof(tree_library::entry);
+	std::string orphaned = bytes;
+	std::memset(&orphaned[first + offsetof(tree_library::record, count)], 0, sizeof(uint16_t));
+	std::ofstream(broken, std::ios::binary | std::ios::trunc) << orphaned;
+	found = library.open(broken) ? library.find<node>(root->state) : nullptr;
+	expect(found && found->children.empty(), "skip the groups whose parent is not built");
+	if (found) search::free_tree(found);
+	library.close();
+
+	std::string recolored = bytes;
+	recolored[first + sizeof(tree_library::record) + offsetof(tree_library::record, who)] = char(root->who);
+	std::ofstream(broken, std::ios::binary | std::ios::trunc) << recolored;
+	found = library.open(broken) ? library.find<node>(root->state) : nullptr;
+	expect(found && found->children.empty(), "skip the groups of moves that cannot be placed");
+	if (found) search::free_tree(found);
+	library.close();
+
+	std::ofstream(broken, std::ios::binary | std::ios::trunc) << bytes.substr(0, bytes.size() - sizeof(tree_library::record));
+	expect(library.open(broken) && !library.find<node>(root->state), "ignore a truncated tree");
+	library.close();
+
+	search::free_tree(root);
+	std::remove(path.c_str());
+	std::remove(broken.c_str());
+}
+
+/**
+ * save the tree of a position again and again, which must compact the library to the latest tree
+ */
+static void check_library_compact() {
+	typedef mcts<node, ucb_selection, random_playout, plain_backup> search;
+	const std::string path = "nogo-check-trees.bin";
+	search_context ctx;
+	search_options opt;
+	search tree(ctx, opt);
+	node* root = new node;
+	root->state = bitboard(board());
+	root->who = board::white;
+	tree.Expansion(root);
+	std::remove(path.c_str());
+	bool saved = true;
+	for (int i = 0; i < 1000; i++) {
+		root->visit = i + 1;
+		saved = saved && tree_library::save(path, root, 1000);
+	}
+	std::ifstream in(path, std::ios::binary | std::ios::ate);
+	expect(saved && size_t(in.tellg()) < (2 << 20), "compact a library to the latest tree of each position");
+	tree_library library;
+	node* found = library.open(path) ? library.find<node>(root->state) : nullptr;
+	expect(library.trees() == 1 && found && found->visit == 1000, "keep the latest tree of a position");
+	if (found) search::free_tree(found);
+	library.close();
+	search::free_tree(root);
+	std::remove(path.c_str());
+}
+
+/**
+ * fix the size of the value cache by the first cache=, and save it to a file, which must load back
+ */
+static void check_cache_fixed() {
+	const std::string path = "nogo-check-values.bin";
+	value_cache& cache = value_cache::global();
+	expect(cache.configure(1) && !cache.configure(2) && cache.enabled(), "keep the size of the first cache=");
+	cache.store(12345, 7, 3);
+	expect(cache.save(path), "save the value cache");
+	int visit = 0, win = 0;
+	expect(cache.load(path) && cache.find(12345, visit, win) && visit == 7 && win == 3, "load the value cache");
+	std::remove(path.c_str());
+}
+
+int main() {
+	check_prune_seeded();
+	check_pool_fixed();
+	check_pool_adopted();
+	check_region_table();
+	check_library_malformed();
+	check_library_compact();
+	check_cache_fixed();
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,276 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * dataset.h: Packed training positions, exported from episode records and mapped from disk
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "board.h"
+#include "action.h"
+#include "bitboard.h"
+#include "episode.h"
+
+/**
+ * the positions of saved episodes as fixed-size records, each position stored once up to symmetry
+ *
+ * a record holds the stones of the side to move and of the opponent, turned to the canonical orientation,
+ * which is the smallest of the 8 under the symmetries of the board, the move played there, and how many of
+ * the games through it were won by the side to move; a position reached again keeps its first move, and adds
+ * up the games and the visits
+ * with the visits of the root moves recorded by record_visits=, a table of the visits of each record follows
+ * the records; the orientations are not stored but applied by read, through the maps of the cells made by
+ * board::transpose and board::rotate, so that the file is 8 times smaller than the augmented positions
+ */
+class dataset {
+public:
+	enum { cells = bitboard::cells, orientations = 8 };
+	enum flag { with_visits = 1 };
+	struct header {
+		char magic[8];
+		uint32_t version;
+		uint32_t flags;
+		uint64_t count;
+		uint64_t reserved; // so that the records start at a multiple of 16
+	};
+	struct alignas(16) record {
+		bitboard::bits own, opp;
+		uint16_t wins, games;
+		uint8_t move; // the cell played
+		uint8_t who; // the color of the side to move
+		uint8_t reserved[10];
+	};
+	typedef std::array<uint16_t, cells> visit_table;
+
+	/**
+	 * a record in one orientation, with the policy from the visits if the file has them, or else the played move
+	 */
+	struct sample {
+		bitboard state;
+		int move;
+		float value; // the fraction of the games won by the side to move
+		float policy[cells];
+	};
+
+	dataset() : base(nullptr), size(0) {}
+	dataset(const dataset&) = delete;
+	dataset& operator =(const dataset&) = delete;
+	~dataset() { close(); }
+
+	/**
+	 * map a dataset file, return false if it cannot be mapped or is not a dataset
+	 */
+	bool open(const std::string& path) {
+		close();
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat st;
+		if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(header)) {
+			void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			if (p != MAP_FAILED) {
+				base = static_cast<const char*>(p);
+				size = st.st_size;
+			}
+		}
+		::close(fd);
+		if (base && (std::memcmp(info().magic, magic(), 8) != 0 || info().version != version || size != layout_size(info()))) close();
+		return base;
+	}
+	void close() {
+		if (base) munmap(const_cast<char*>(base), size);
+		base = nullptr;
+		size = 0;
+	}
+
+	size_t records() const { return base ? info().count : 0; }
+	bool has_visits() const { return base && (info().flags & with_visits); }
+	const record& at(size_t i) const { return reinterpret_cast<const record*>(base + sizeof(header))[i]; }
+	const visit_table& visits(size_t i) const {
+		return reinterpret_cast<const visit_table*>(base + sizeof(header) + info().count * sizeof(record))[i];
+	}
+
+	/**
+	 * read the i-th record in orientation t of [0, 8)
+	 */
+	void read(size_t i, int t, sample& s) const {
+		const record& r = at(i);
+		const std::array<uint8_t, cells>& to = maps()[t];
+		bitboard::bits own = transform(r.own, t), opp = transform(r.opp, t);
+		board::piece_type who = static_cast<board::piece_type>(r.who);
+		s.state = who == board::black ? bitboard(own, opp, who) : bitboard(opp, own, who);
+		s.move = to[r.move];
+		s.value = r.games ? float(r.wins) / r.games : 0.5f;
+		std::fill(s.policy, s.policy + cells, 0.0f);
+		if (has_visits()) {
+			const visit_table& v = visits(i);
+			float sum = 0;
+			for (int k = 0; k < cells; k++) sum += v[k];
+			if (sum > 0) for (int k = 0; k < cells; k++) s.policy[to[k]] = v[k] / sum;
+			else s.policy[s.move] = 1;
+		} else {
+			s.policy[s.move] = 1;
+		}
+	}
+
+public:
+	/**
+	 * the cell that each cell moves to in each orientation, made by turning a board whose cells hold their indices
+	 * orientation t transposes the board if t & 4, and then rotates it clockwise t & 3 times
+	 */
+	static const std::array<std::array<uint8_t, cells>, orientations>& maps() {
+		static const std::array<std::array<uint8_t, cells>, orientations> to = []() {
+			std::array<std::array<uint8_t, cells>, orientations> to;
+			for (int t = 0; t < orientations; t++) {
+				board::grid index;
+				for (int i = 0; i < cells; i++) index[i / board::size_y][i % board::size_y] = i;
+				board turned(index, { board::black });
+				if (t & 4) turned.transpose();
+				turned.rotate(t & 3);
+				for (int i = 0; i < cells; i++) to[t][turned(i)] = i;
+			}
+			return to;
+		}();
+		return to;
+	}
+
+	static bitboard::bits transform(bitboard::bits b, int t) {
+		const std::array<uint8_t, cells>& to = maps()[t];
+		bitboard::bits res = 0;
+		for (; b; b &= b - 1) res |= bitboard::bit(to[bitboard::lowest(b)]);
+		return res;
+	}
+
+	/**
+	 * export the episodes of a file saved by --save to a dataset, and return the number of records,
+	 * or -1 if the dataset cannot be written
+	 *
+	 * the last player to move in an episode wins, so that an episode whose final position still has a legal
+	 * move for the side to move, e.g., of an unfinished GTP session, is left out
+	 */
+	static long build(std::istream& in, const std::string& path) {
+		std::vector<record> table;
+		std::vector<std::array<uint32_t, cells> > counts;
+		bool any_visits = false;
+		std::unordered_map<std::pair<bitboard::bits, bitboard::bits>, size_t, canonical_hash> index;
+		for (std::string line; std::getline(in, line); ) {
+			if (line.empty() || line[0] != '(') continue;
+			episode game;
+			if (!(std::stringstream(line) >> game)) continue;
+			std::vector<action> moves = game.actions();
+			std::vector<bitboard> positions;
+			board state;
+			bool legal = true;
+			for (size_t i = 0; i < moves.size() && legal; i++) {
+				positions.push_back(bitboard(state));
+				legal = moves[i].apply(state) == board::legal;
+			}
+			bitboard last(state);
+			if (!legal || last.legal_moves(last.take_turns())) continue;
+			const unsigned winner = 3u - last.take_turns();
+
+			for (size_t i = 0; i < positions.size(); i++) {
+				const unsigned who = positions[i].take_turns();
+				bitboard::bits own = positions[i].stones(who), opp = positions[i].stones(3u - who);
+				int t = canonical(own, opp);
+				const std::array<uint8_t, cells>& to = maps()[t];
+				std::pair<bitboard::bits, bitboard::bits> key(transform(own, t), transform(opp, t));
+				auto it = index.find(key);
+				if (it == index.end()) {
+					it = index.emplace(key, table.size()).first;
+					record r = {};
+					r.own = key.first;
+					r.opp = key.second;
+					r.move = to[action::place(moves[i]).position().i];
+					r.who = who;
+					table.push_back(r);
+					counts.emplace_back();
+					counts.back().fill(0);
+				}
+				record& r = table[it->second];
+				if (r.games < UINT16_MAX) {
+					r.games += 1;
+					r.wins += (who == winner);
+				}
+				for (const std::pair<int, int>& v : game.visits(i)) {
+					if (v.first < 0 || v.first >= cells || v.second <= 0) continue;
+					counts[it->second][to[v.first]] += v.second;
+					any_visits = true;
+				}
+			}
+		}
+
+		header h = {};
+		std::memcpy(h.magic, magic(), 8);
+		h.version = version;
+		h.flags = any_visits ? with_visits : 0;
+		h.count = table.size();
+		std::string temp = path + ".tmp";
+		std::ofstream out(temp, std::ios::out | std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+		out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(record));
+		if (any_visits) {
+			for (const std::array<uint32_t, cells>& c : counts) { // scaled down to fit, if needed
+				uint32_t max = *std::max_element(c.begin(), c.end());
+				visit_table v;
+				for (int k = 0; k < cells; k++) v[k] = max > UINT16_MAX ? uint64_t(c[k]) * UINT16_MAX / max : c[k];
+				out.write(reinterpret_cast<const char*>(v.data()), sizeof(v));
+			}
+		}
+		out.close();
+		if (!out.good() || std::rename(temp.c_str(), path.c_str()) != 0) return -1;
+		return table.size();
+	}
+
+private:
+	struct canonical_hash {
+		size_t operator ()(const std::pair<bitboard::bits, bitboard::bits>& k) const {
+			uint64_t h = uint64_t(k.first) * 0x9e3779b97f4a7c15ull ^ uint64_t(k.first >> 64);
+			h = (h ^ uint64_t(k.second)) * 0xbf58476d1ce4e5b9ull ^ uint64_t(k.second >> 64);
+			return h ^ (h >> 31);
+		}
+	};
+
+	/**
+	 * the orientation whose stones are the smallest, first by those of the side to move
+	 */
+	static int canonical(bitboard::bits own, bitboard::bits opp) {
+		int best = 0;
+		bitboard::bits best_own = own, best_opp = opp;
+		for (int t = 1; t < orientations; t++) {
+			bitboard::bits o = transform(own, t), p = transform(opp, t);
+			if (o < best_own || (o == best_own && p < best_opp)) {
+				best = t;
+				best_own = o;
+				best_opp = p;
+			}
+		}
+		return best;
+	}
+
+	static const char* magic() { return "NOGODATA"; }
+	enum { version = 1 };
+
+	const header& info() const { return *reinterpret_cast<const header*>(base); }
+	static size_t layout_size(const header& h) {
+		return sizeof(header) + h.count * (sizeof(record) + (h.flags & with_visits ? sizeof(visit_table) : 0));
+	}
+
+	const char* base;
+	size_t size;
+};
@@ -36,10 +36,11 @@ public:
 	void close_episode(const std::string& tag) {
 		ep_close = { tag, millisec() };
 	}
-	bool apply_action(action move) {
+	bool apply_action(action move, const std::vector<std::pair<int, int> >& visits = {}) {
 		board::reward reward = move.apply(state());
 		if (reward != board::legal) return false;
 		ep_moves.emplace_back(move, reward, millisec() - ep_time);
+		ep_moves.back().visits = visits;
 		ep_score += reward;
 		return true;
 	}
@@ -102,6 +103,11 @@ public:
 		return res;
 	}
 
+	/**
+	 * the visits of the root moves searched for the i-th move, as pairs of cell and visits, if recorded
+	 */
+	const std::vector<std::pair<int, int> >& visits(size_t i) const { return ep_moves.at(i).visits; }
+
 public:
 
 	friend std::ostream& operator <<(std::ostream& out, const episode& ep) {
@@ -148,27 +154,49 @@ public:
 
 protected:
 
+	/**
+	 * a move with its time, and the visits of the root moves of its search as VS[D4:120,E5:40] if recorded
+	 */
 	struct move {
 		action code;
 		board::reward reward;
 		time_t time;
+		std::vector<std::pair<int, int> > visits;
 		move(action code = {}, board::reward reward = 0, time_t time = 0) : code(code), reward(reward), time(time) {}
 
 		operator action() const { return code; }
 		friend std::ostream& operator <<(std::ostream& out, const move& m) {
 			out << m.code;
 			if (m.time) out << "C[" << std::dec << m.time << "]";
+			if (m.visits.size()) {
+				out << "VS[";
+				for (size_t i = 0; i < m.visits.size(); i++)
+					out << (i ? "," : "") << std::string(board::point(m.visits[i].first)) << ':' << std::dec << m.visits[i].second;
+				out << "]";
+			}
 			return out;
 		}
 		friend std::istream& operator >>(std::istream& in, move& m) {
 			in >> m.code;
 			m.reward = 0;
 			m.time = 0;
+			m.visits.clear();
 			if (in.peek() == 'C') {
 				in.ignore(2); // C[
 				in >> std::dec >> m.time;
 				in.ignore(1); // ]
 			}
+			if (in.peek() == 'V') {
+				in.ignore(3); // VS[
+				std::string list;
+				std::getline(in, list, ']');
+				std::stringstream ss(list);
+				for (std::string item; std::getline(ss, item, ','); ) {
+					size_t colon = item.find(':');
+					if (colon == std::string::npos) continue;
+					m.visits.emplace_back(board::point(item.substr(0, colon)).i, std::stoi(item.substr(colon + 1)));
+				}
+			}
 			return in;
 		}
 	};
@@ -0,0 +1,96 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * libnogo.cpp: Implementation of the C interface in nogo.h
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+#include "episode.h"
+#include "statistics.h"
+#include "nogo.h"
+
+/**
+ * the player of an engine, with its position and the result of its last search
+ */
+struct nogo_engine {
+	nogo_engine(const std::string& args) : player("name=engine " + args + " role=both") {}
+
+	MCTS_player player;
+	board state;
+	MCTS_player::analysis last;
+};
+
+extern "C" {
+
+int nogo_api_version(void) {
+	return NOGO_API_VERSION;
+}
+
+nogo_engine* nogo_engine_create(const char* args) {
+	try {
+		return new nogo_engine(args ? args : "");
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void nogo_engine_free(nogo_engine* engine) {
+	delete engine;
+}
+
+int nogo_engine_set_position(nogo_engine* engine, const int* cells, size_t count) {
+	engine->state = board();
+	engine->last = {};
+	for (size_t i = 0; i < count; i++)
+		if (nogo_engine_play(engine, cells[i]) != 0) return i + 1;
+	return 0;
+}
+
+int nogo_engine_play(nogo_engine* engine, int cell) {
+	if (cell < 0 || cell >= int(board::size_x * board::size_y)) return -1;
+	board after = engine->state;
+	if (action::place(cell, after.info().who_take_turns).apply(after) != board::legal) return -1;
+	engine->state = after;
+	return 0;
+}
+
+int nogo_engine_to_move(const nogo_engine* engine) {
+	return engine->state.info().who_take_turns;
+}
+
+int nogo_engine_search(nogo_engine* engine, int simulations) {
+	try {
+		engine->last = engine->player.analyze(engine->state, board::size_x * board::size_y, simulations);
+	} catch (...) {
+		engine->last = {};
+	}
+	action::place best = engine->last.best;
+	return action(best).type() == action::place::type ? best.position().i : -1;
+}
+
+size_t nogo_engine_stats(const nogo_engine* engine, nogo_move_stat* stats, size_t capacity) {
+	const std::vector<search_control::child>& children = engine->last.root.children;
+	for (size_t i = 0; i < children.size() && i < capacity; i++) {
+		const search_control::child& c = children[i];
+		stats[i] = { c.move.position().i, c.visit, c.win, c.lower(), c.upper() };
+	}
+	return children.size();
+}
+
+size_t nogo_engine_pv(const nogo_engine* engine, int* cells, size_t capacity) {
+	const std::vector<search_control::child>& children = engine->last.root.children;
+	if (children.empty()) return 0;
+	const std::vector<action::place>& pv = children[0].pv;
+	for (size_t i = 0; i < pv.size() && i < capacity; i++) cells[i] = pv[i].position().i;
+	return pv.size();
+}
+
+}
@@ -0,0 +1,304 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * library.h: Binary snapshots of search trees, saved to and mapped from disk
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <tuple>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/syscall.h>
+#include "board.h"
+#include "action.h"
+#include "bitboard.h"
+
+/**
+ * a library of search trees, one for each root position, stored in a file that is mapped as it is
+ *
+ * the file is a header followed by the trees, each an entry and then its nodes in breadth-first order, where
+ * the children of a node are consecutive; all fields have a fixed size, so that opening a library only maps
+ * the file and walks the entries, and a tree is built from its records once its root position is asked for
+ * a tree keeps whole groups of siblings, so that every node with children in the file is fully expanded
+ * the trees are appended, each by a single write under a lock of the file, so that saving costs the size of
+ * the tree rather than of the file, and several writers may share a file; a later tree of a position hides the
+ * earlier ones, and a truncated tree at the end is ignored
+ * once the file has doubled since it was last compacted, it is compacted to the latest tree of every position
+ * and renamed into place, so that the hidden trees do not pile up; the files already mapped stay as they are
+ */
+class tree_library {
+public:
+	struct header {
+		char magic[8];
+		uint32_t version;
+		uint32_t compacted; // the size of the file in KiB when it was last compacted
+	};
+	struct alignas(16) entry {
+		bitboard::bits black, white, space;
+		uint32_t who; // the side to move at the root
+		uint32_t count; // the records that follow
+		uint64_t reserved;
+	};
+	struct record {
+		int32_t visit;
+		int32_t win;
+		uint32_t first; // the index of the first child within the tree
+		uint16_t count; // the number of children, 0 for a leaf
+		uint8_t cell;
+		uint8_t who;
+	};
+
+	tree_library() : base(nullptr), size(0) {}
+	tree_library(const tree_library&) = delete;
+	tree_library& operator =(const tree_library&) = delete;
+	~tree_library() { close(); }
+
+	/**
+	 * map a library file, return false if it cannot be mapped or is not a library
+	 */
+	bool open(const std::string& path) {
+		close();
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat st;
+		if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(header)) {
+			void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p != MAP_FAILED) {
+				base = static_cast<const char*>(p);
+				size = st.st_size;
+			}
+		}
+		::close(fd);
+		if (base && (std::memcmp(info().magic, magic(), 8) != 0 || info().version != version)) close();
+		if (base) latest = scan(base, size);
+		return base;
+	}
+	void close() {
+		if (base) munmap(const_cast<char*>(base), size);
+		base = nullptr;
+		size = 0;
+		latest.clear();
+	}
+
+	size_t trees() const { return latest.size(); }
+
+	/**
+	 * build the stored tree of the position, or return nullptr if the library has none
+	 *
+	 * a group of children is only linked if it lies after its parent, within the tree, on cells that are empty
+	 * in the state of the parent, by the color that moves after the parent, and apart from any group linked
+	 * before, so that every node is built once below a built parent as a move that can be placed, and the nodes
+	 * that a malformed file leaves unlinked are skipped
+	 */
+	template<class node_type>
+	node_type* find(const bitboard& state) const {
+		const entry* e = lookup(state);
+		if (!e) return nullptr;
+		const record* nodes = reinterpret_cast<const record*>(e + 1);
+		std::vector<node_type*> built(e->count, nullptr);
+		built[0] = new node_type;
+		built[0]->state = state;
+		built[0]->who = static_cast<board::piece_type>(3u - e->who);
+		for (uint32_t i = 0; i < e->count; i++) {
+			node_type* n = built[i];
+			if (!n) continue;
+			n->visit = nodes[i].visit;
+			n->win = nodes[i].win;
+			const uint32_t first = nodes[i].first, count = nodes[i].count;
+			if (count == 0 || first <= i || first > e->count || count > e->count - first) continue;
+			bool valid = true;
+			const uint32_t turn = 3u - n->who;
+			for (uint32_t k = first; k < first + count && valid; k++)
+				valid = !built[k] && nodes[k].cell < bitboard::cells && (n->state.empty() & bitboard::bit(nodes[k].cell))
+					&& nodes[k].who == turn;
+			if (!valid) continue;
+			n->children.reserve(count);
+			for (uint32_t k = first; k < first + count; k++) {
+				node_type* child = built[k] = new node_type;
+				child->state = n->state;
+				child->state.place(nodes[k].cell, nodes[k].who);
+				child->parent = n;
+				child->move = action::place(nodes[k].cell, nodes[k].who);
+				child->who = static_cast<board::piece_type>(nodes[k].who);
+				n->children.push_back(child);
+			}
+			n->expansion.store(node_type::expanded_state, std::memory_order_relaxed);
+		}
+		return built[0];
+	}
+
+	/**
+	 * add the tree below root, at most max_nodes of it, to the library, where it hides any earlier tree of the
+	 * same position
+	 *
+	 * the sibling groups are taken in order of the visits of their parents, as long as the whole group fits;
+	 * a missing file is created with its header under a unique name and linked into place, so that no writer
+	 * ever sees a file without one, and the tree is appended by a single write, so that the mappings of the
+	 * file stay valid
+	 */
+	template<class node_type>
+	static bool save(const std::string& path, const node_type* root, size_t max_nodes) {
+		std::vector<const node_type*> kept = { root };
+		std::vector<const node_type*> open = { root }; // the nodes whose children may be kept, as a heap by visits
+		auto fewer = [](const node_type* a, const node_type* b) { return a->visit < b->visit; };
+		std::vector<const node_type*> parents;
+		while (open.size()) {
+			std::pop_heap(open.begin(), open.end(), fewer);
+			const node_type* n = open.back();
+			open.pop_back();
+			if (!n->expanded() || n->children.empty() || kept.size() + n->children.size() > max_nodes) continue;
+			parents.push_back(n);
+			for (const node_type* child : n->children) {
+				kept.push_back(child);
+				open.push_back(child);
+				std::push_heap(open.begin(), open.end(), fewer);
+			}
+		}
+		std::sort(parents.begin(), parents.end());
+
+		// lay the kept nodes out in breadth-first order, after the entry of the tree
+		std::vector<record> tree;
+		std::vector<const node_type*> queue = { root };
+		for (size_t i = 0; i < queue.size(); i++) {
+			const node_type* n = queue[i];
+			record r = { int32_t(n->visit), int32_t(n->win), 0, 0, uint8_t(n->move.position().i), uint8_t(n->who) };
+			if (std::binary_search(parents.begin(), parents.end(), n)) {
+				r.first = queue.size();
+				r.count = n->children.size();
+				for (const node_type* child : n->children) queue.push_back(child);
+			}
+			tree.push_back(r);
+		}
+		entry e = {};
+		e.black = root->state.stones(board::black);
+		e.white = root->state.stones(board::white);
+		e.space = root->state.empty();
+		e.who = root->state.take_turns();
+		e.count = tree.size();
+		std::vector<char> chunk(sizeof(entry) + tree.size() * sizeof(record));
+		std::memcpy(chunk.data(), &e, sizeof(entry));
+		std::memcpy(chunk.data() + sizeof(entry), tree.data(), tree.size() * sizeof(record));
+
+		int fd = lock(path);
+		if (fd < 0) return false;
+		header h;
+		bool ok = pread(fd, &h, sizeof(h), 0) == ssize_t(sizeof(h)) && std::memcmp(h.magic, magic(), 8) == 0 && h.version == version;
+		ok = ok && write(fd, chunk.data(), chunk.size()) == ssize_t(chunk.size());
+		struct stat st;
+		if (ok && fstat(fd, &st) == 0 && size_t(st.st_size) > std::max<size_t>(size_t(h.compacted) << 11, 1 << 20))
+			compact(path, fd, st.st_size);
+		::close(fd);
+		return ok;
+	}
+
+private:
+	static const char* magic() { return "NOGOTREE"; }
+	enum { version = 2 };
+
+	const header& info() const { return *reinterpret_cast<const header*>(base); }
+
+	typedef std::tuple<bitboard::bits, bitboard::bits, bitboard::bits, uint32_t> position;
+
+	/**
+	 * the latest tree of the position
+	 */
+	const entry* lookup(const bitboard& state) const {
+		auto it = latest.find(position(state.stones(board::black), state.stones(board::white), state.empty(), state.take_turns()));
+		return it != latest.end() ? reinterpret_cast<const entry*>(base + it->second) : nullptr;
+	}
+
+	/**
+	 * the offset of the latest tree of each position in the mapped file, up to a truncated tree
+	 */
+	static std::map<position, size_t> scan(const char* base, size_t size) {
+		std::map<position, size_t> found;
+		for (size_t at = sizeof(header); at + sizeof(entry) <= size; ) {
+			const entry& e = *reinterpret_cast<const entry*>(base + at);
+			if (e.count == 0 || e.count > (size - at - sizeof(entry)) / sizeof(record)) break;
+			found[position(e.black, e.white, e.space, e.who)] = at;
+			at += sizeof(entry) + e.count * sizeof(record);
+		}
+		return found;
+	}
+
+	/**
+	 * open the library at path for appending, with an exclusive lock, making an empty library if there is none,
+	 * and return the descriptor, or -1 on failure
+	 * a file that has been compacted and replaced while waiting for the lock is opened again
+	 */
+	static int lock(const std::string& path) {
+		for (int attempt = 0; attempt < 16; attempt++) {
+			int fd = ::open(path.c_str(), O_RDWR | O_APPEND);
+			if (fd < 0 && errno == ENOENT && create(path)) continue;
+			if (fd < 0) return -1;
+			struct stat locked, current;
+			if (flock(fd, LOCK_EX) == 0 && fstat(fd, &locked) == 0 && stat(path.c_str(), &current) == 0
+					&& locked.st_ino == current.st_ino && locked.st_dev == current.st_dev) return fd;
+			::close(fd);
+		}
+		return -1;
+	}
+
+	/**
+	 * rewrite the locked library at path, of the given size, with only the latest tree of every position, in the
+	 * order they were saved, and rename it into place; the library is left as it is on failure
+	 */
+	static void compact(const std::string& path, int fd, size_t size) {
+		void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED) return;
+		const char* base = static_cast<const char*>(p);
+		std::vector<size_t> kept;
+		for (const auto& tree : scan(base, size)) kept.push_back(tree.second);
+		std::sort(kept.begin(), kept.end());
+		header h = *reinterpret_cast<const header*>(base);
+		size_t total = sizeof(header);
+		for (size_t at : kept) total += sizeof(entry) + reinterpret_cast<const entry*>(base + at)->count * sizeof(record);
+		h.compacted = uint32_t(std::min<size_t>(total >> 10, UINT32_MAX));
+		std::string temp = path + "." + std::to_string(getpid()) + "." + std::to_string(syscall(SYS_gettid));
+		int out = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+		bool ok = out >= 0 && write(out, &h, sizeof(h)) == ssize_t(sizeof(h));
+		for (size_t at : kept) {
+			size_t bytes = sizeof(entry) + reinterpret_cast<const entry*>(base + at)->count * sizeof(record);
+			ok = ok && write(out, base + at, bytes) == ssize_t(bytes);
+		}
+		if (out >= 0) ::close(out);
+		if (!(ok && rename(temp.c_str(), path.c_str()) == 0)) unlink(temp.c_str());
+		munmap(p, size);
+	}
+
+	/**
+	 * make an empty library at path unless there is a file already, and return false only on failure
+	 */
+	static bool create(const std::string& path) {
+		std::string temp = path + "." + std::to_string(getpid()) + "." + std::to_string(syscall(SYS_gettid));
+		int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+		if (fd < 0) return false;
+		header h = {};
+		std::memcpy(h.magic, magic(), 8);
+		h.version = version;
+		bool ok = write(fd, &h, sizeof(h)) == ssize_t(sizeof(h));
+		::close(fd);
+		ok = ok && (link(temp.c_str(), path.c_str()) == 0 || errno == EEXIST);
+		unlink(temp.c_str());
+		return ok;
+	}
+
+	const char* base;
+	size_t size;
+	std::map<position, size_t> latest; // the offsets of the entries
+};
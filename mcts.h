@@ -0,0 +1,1013 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * mcts.h: Monte-Carlo tree search as a template over the board and the search policies
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <array>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include <chrono>
+#include <mutex>
+#include <iostream>
+#include <type_traits>
+#include "board.h"
+#include "action.h"
+#include "bitboard.h"
+#include "pool.h"
+#include "cache.h"
+#include "network.h"
+
+/**
+ * a node of the search tree, reached from its parent by the move of who
+ *
+ * the children are published by the state word expansion, see mcts::Expansion, and they may only be
+ * read once expanded() holds; a concurrent node is shared by all search threads, so that its
+ * statistics are atomic counters
+ * with huge_pages= given, the nodes are allocated from the pool of the thread that creates them, see node_pool
+ */
+template<class board_type, bool concurrent = false>
+class basic_node {
+public:
+	typedef board_type state_type;
+	typedef typename std::conditional<concurrent, std::atomic<int>, int>::type counter;
+	enum expansion_state { unexpanded = 0, expanding = 1, expanded_state = 2 };
+	static const bool shared = concurrent;
+
+	bool expanded() const { return expansion.load(std::memory_order_acquire) == expanded_state; }
+
+	static void* operator new(size_t size) {
+		return node_pool::enabled() ? node_pool::local<sizeof(basic_node)>().allocate() : ::operator new(size);
+	}
+	static void operator delete(void* p) {
+		if (node_pool::enabled()) node_pool::release(p);
+		else ::operator delete(p);
+	}
+	static void* allocate_contiguous() {
+		return node_pool::enabled() ? node_pool::local<sizeof(basic_node)>().allocate_contiguous() : ::operator new(sizeof(basic_node));
+	}
+
+	board_type state;
+	board::piece_type who;
+	counter win{0};
+	counter visit{0};
+	action::place move;
+	basic_node* parent = nullptr;
+	std::vector<basic_node*> children;
+	std::atomic<int> expansion{unexpanded};
+	bool cached = false; // seeded from the value cache, so that its children may be there as well
+};
+typedef basic_node<bitboard> node;
+typedef basic_node<bitboard, true> shared_node;
+
+/**
+ * lay out the tree below root again, so that the children of every node with at least min_visit visits lie
+ * next to each other, and the groups of siblings follow a depth-first order of their parents
+ *
+ * the nodes are moved to newly allocated blocks and the old ones are freed, so that no pointer into the tree
+ * below root stays valid; a group that already lies at a constant stride is left in place, so that repeated
+ * passes only move the groups that have grown or been scattered since
+ * the blocks are contiguous with huge_pages= given, see node_pool::allocate_contiguous, and in allocation order
+ * of the global allocator otherwise
+ * the tree must not be searched meanwhile
+ */
+template<class node_type>
+void compact_tree(node_type* root, int min_visit) {
+	auto contiguous = [](const std::vector<node_type*>& group) {
+		if (group.size() < 2) return true;
+		std::ptrdiff_t stride = reinterpret_cast<char*>(group[1]) - reinterpret_cast<char*>(group[0]);
+		if (stride <= 0 || stride > std::ptrdiff_t(2 * sizeof(node_type))) return false;
+		for (size_t i = 2; i < group.size(); i++)
+			if (reinterpret_cast<char*>(group[i]) - reinterpret_cast<char*>(group[i - 1]) != stride) return false;
+		return true;
+	};
+	std::vector<node_type*> stack = { root };
+	while (stack.size()) {
+		node_type* n = stack.back();
+		stack.pop_back();
+		if (!contiguous(n->children)) {
+			for (node_type*& child : n->children) {
+				node_type* moved = ::new (node_type::allocate_contiguous()) node_type;
+				moved->state = child->state;
+				moved->who = child->who;
+				moved->win = int(child->win);
+				moved->visit = int(child->visit);
+				moved->move = child->move;
+				moved->cached = child->cached;
+				moved->parent = n;
+				moved->children.swap(child->children);
+				moved->expansion.store(child->expansion.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				for (node_type* grandchild : moved->children) grandchild->parent = moved;
+				delete child;
+				child = moved;
+			}
+		}
+		for (auto it = n->children.rbegin(); it != n->children.rend(); ++it)
+			if ((*it)->visit >= min_visit && (*it)->children.size()) stack.push_back(*it);
+	}
+}
+
+/**
+ * give a node the statistics of its position from the value cache, scaled down to at most cap visits,
+ * and return whether the position is there
+ */
+template<class node_type>
+bool seed_node(node_type* n, uint64_t key, int cap) {
+	int visit, win;
+	if (!value_cache::global().find(key, visit, win) || visit <= 0) return false;
+	int prior = std::min(visit, cap);
+	n->visit = prior;
+	n->win = int((long long) win * prior / visit);
+	n->cached = true;
+	return true;
+}
+
+/**
+ * store the statistics of root and the nodes below it with at least min_visit visits into the value cache
+ * the expanded nodes are read only, so that a shared tree may be stored while it is searched
+ */
+template<class node_type>
+void remember_tree(node_type* root, int min_visit) {
+	std::vector<node_type*> stack = { root };
+	while (stack.size()) {
+		node_type* n = stack.back();
+		stack.pop_back();
+		value_cache::global().store(value_cache::key(n->state, n->who), n->visit, n->win);
+		if (!n->expanded()) continue;
+		for (node_type* child : n->children)
+			if (child->visit >= min_visit) stack.push_back(child);
+	}
+}
+
+/**
+ * last good reply with forgetting (LGRF-1) for the playouts
+ *
+ * reply[who][last] is the latest reply of who to the opponent move at last that won its playout,
+ * and it is forgotten as soon as it loses; the moves of the current simulation, from the first
+ * move below the root to the end of the playout, are kept in trace for the update
+ * each search thread owns a table, so that neither reads nor updates need any locking
+ */
+class reply_table {
+public:
+	reply_table() : first(board::black) {
+		for (auto& r : reply) r.fill(-1);
+		trace.reserve(bitboard::cells);
+	}
+
+	int get(unsigned who, int last) const {
+		return last >= 0 ? reply[who - 1][last] : -1;
+	}
+
+	void update(board::piece_type winner) {
+		unsigned who = first;
+		for (size_t k = 1; k < trace.size(); k++) {
+			who = 3u - who;
+			int16_t& r = reply[who - 1][trace[k - 1]];
+			if (who == winner) r = trace[k];
+			else if (r == trace[k]) r = -1;
+		}
+	}
+
+	std::vector<int> trace;
+	board::piece_type first;
+
+private:
+	std::array<std::array<int16_t, bitboard::cells>, 2> reply;
+};
+
+/**
+ * the exchange buffer for the periodic synchronization of root-parallel searches
+ *
+ * the statistics are keyed by the moves from the root: key (i) is the root child at cell i,
+ * key (cells + i * cells + j) is its child at cell j, and the last 2 * cells keys are the RAVE table
+ * every thread owns a slot, to which it publishes the cumulative statistics of its own simulations,
+ * and from which the other threads only read, so that nothing is locked; a reader that sees a slot
+ * being written only lags behind until the next synchronization, as the counters never decrease
+ */
+class exchange_buffer {
+public:
+	enum key { shallow = bitboard::cells * (bitboard::cells + 1), keys = shallow + 2 * bitboard::cells };
+
+	exchange_buffer(int threads) : threads(threads), slots(new counter[threads * keys]) {}
+
+	void publish(int slot, int key, int visit, int win) {
+		counter& c = slots[slot * keys + key];
+		c.win.store(win, std::memory_order_relaxed);
+		c.visit.store(visit, std::memory_order_relaxed);
+	}
+
+	/**
+	 * sum the statistics of key over the slots other than the given one
+	 */
+	void collect(int slot, int key, int& visit, int& win) const {
+		visit = win = 0;
+		for (int t = 0; t < threads; t++) {
+			if (t == slot) continue;
+			const counter& c = slots[t * keys + key];
+			visit += c.visit.load(std::memory_order_relaxed);
+			win += c.win.load(std::memory_order_relaxed);
+		}
+	}
+
+private:
+	struct counter {
+		std::atomic<int> visit{0};
+		std::atomic<int> win{0};
+	};
+	int threads;
+	std::unique_ptr<counter[]> slots;
+};
+
+/**
+ * the control of a running search from another thread, see MCTS_player::start
+ *
+ * the search threads check stop after every simulation, and copy the statistics of their root into a slot
+ * of their own every interval, so that a reader only takes the lock of a slot and never touches a tree
+ * being searched
+ */
+class search_control {
+public:
+	/**
+	 * a root child, with its principal variation if it is visited
+	 */
+	struct child {
+		action::place move;
+		int visit = 0;
+		int win = 0;
+		std::vector<action::place> pv;
+
+		double value() const { return visit ? double(win) / visit : 0; }
+		/**
+		 * the Wilson score interval of the value, z standard deviations wide
+		 */
+		double lower(double z = 1.96) const { return bound(-z); }
+		double upper(double z = 1.96) const { return bound(z); }
+
+	private:
+		double bound(double z) const {
+			if (visit == 0) return z < 0 ? 0 : 1;
+			double p = value(), n = visit;
+			return (p + z * z / (2 * n) + z * std::sqrt(p * (1 - p) / n + z * z / (4 * n * n))) / (1 + z * z / n);
+		}
+	};
+	/**
+	 * the root children by visits and the visits of the root
+	 */
+	struct snapshot {
+		std::vector<child> children;
+		int visit = 0;
+	};
+
+	search_control() : stop(false), infinite(false), interval(std::chrono::milliseconds(5)) {}
+
+	void reset(int threads, bool unlimited = false) {
+		stop = false;
+		infinite = unlimited;
+		slots.clear();
+		for (int i = 0; i < threads; i++) slots.emplace_back(new slot);
+	}
+
+	void publish(int i, snapshot& s) {
+		std::lock_guard<std::mutex> guard(slots[i]->lock);
+		std::swap(slots[i]->last, s);
+	}
+
+	/**
+	 * merge the latest snapshots of all threads, where the principal variation of a move is the longest one
+	 * among the threads, and a visited move has at least itself as its variation
+	 */
+	snapshot collect() const {
+		snapshot merged;
+		for (const std::unique_ptr<slot>& s : slots) {
+			std::lock_guard<std::mutex> guard(s->lock);
+			merged.visit += s->last.visit;
+			for (const child& c : s->last.children) {
+				auto it = std::find_if(merged.children.begin(), merged.children.end(),
+					[&](const child& m) { return m.move.position().i == c.move.position().i; });
+				if (it == merged.children.end()) it = merged.children.insert(merged.children.end(), c);
+				else it->visit += c.visit, it->win += c.win;
+				if (c.pv.size() > it->pv.size()) it->pv = c.pv;
+			}
+		}
+		std::stable_sort(merged.children.begin(), merged.children.end(), [](const child& a, const child& b) {
+			return a.visit != b.visit ? a.visit > b.visit : (double) a.win / std::max(a.visit, 1) > (double) b.win / std::max(b.visit, 1);
+		});
+		for (child& c : merged.children) if (c.visit && c.pv.empty()) c.pv.push_back(c.move);
+		return merged;
+	}
+
+	std::atomic<bool> stop;
+	bool infinite; // ignore simulation=, which still sets the RAVE equivalence
+	std::chrono::steady_clock::duration interval;
+
+private:
+	struct slot {
+		std::mutex lock;
+		snapshot last;
+	};
+	std::vector<std::unique_ptr<slot> > slots;
+};
+
+/**
+ * the state that a search thread keeps across its simulations and across moves
+ * every context is owned by one thread at a time, so nothing in it is locked
+ * except the exchange buffer, which is shared by the threads of a synchronized search
+ */
+class search_context {
+public:
+	struct record {
+		int visit = 0;
+		int win = 0;
+	};
+
+	record& rave(const action::place& move) { return amaf[move.color() - 1][move.position().i]; }
+	const record& rave(const action::place& move) const { return amaf[move.color() - 1][move.position().i]; }
+
+	std::default_random_engine engine;
+	std::array<std::array<record, bitboard::cells>, 2> amaf;
+	reply_table replies;
+	int count = 0;
+
+	long nodes = 0; // the size of the tree of the thread, or the shared tree through shared_nodes
+	std::atomic<long>* shared_nodes = nullptr;
+
+	exchange_buffer* exchange = nullptr;
+	search_control* control = nullptr;
+	int slot = 0;
+	std::vector<record> base;
+	std::vector<record> received;
+};
+
+/**
+ * the runtime parameters of a search, see MCTS_player for their meanings
+ */
+struct search_options {
+	int simulation_count = 0;
+	int truncate_margin = 0;
+	int tactics_budget = 0;
+	int candidate_num = 16;
+	std::string root_search = "ucb";
+	int sync_interval = 0;
+	long max_nodes = 0;
+	int compact_interval = 0;
+	int compact_visits = 16;
+	int multipv = 1;
+	int multipv_visits = 0;
+	int cache_prior = 0;
+	int cache_visits = 16;
+};
+
+/**
+ * selection policies, which score a child for the player who moves into it
+ */
+struct ucb_rave_selection {
+	/**
+	 * UCB1 mixed with the RAVE win rate of the same move over all simulations of the thread,
+	 * where the RAVE weight beta = sqrt(k / (3n + k)) fades as the thread runs more simulations
+	 * without RAVE statistics (e.g., with backup=plain) it is plain UCB1
+	 */
+	template<class node_type>
+	static double value(const node_type* cur, const search_context& ctx, const search_options& opt) {
+		const search_context::record& rave = ctx.rave(cur->move);
+		if (cur->visit == 0) return 1e8;
+		double constant = std::sqrt(2);
+		double beta = std::sqrt((double) opt.simulation_count / (double) (3 * ctx.count + opt.simulation_count));
+		double win_rate = (double) cur->win / (double) cur->visit;
+		double rave_win_rate = rave.visit ? (double) rave.win / (double) rave.visit : win_rate;
+		double exploitation = (1 - beta) * win_rate + beta * rave_win_rate;
+		double exploration = std::sqrt(std::log((double) cur->parent->visit) / cur->visit);
+		return exploitation + constant * exploration;
+	}
+};
+
+struct ucb_selection {
+	/**
+	 * plain UCB1
+	 */
+	template<class node_type>
+	static double value(const node_type* cur, const search_context& ctx, const search_options& opt) {
+		if (cur->visit == 0) return 1e8;
+		double win_rate = (double) cur->win / (double) cur->visit;
+		return win_rate + std::sqrt(2 * std::log((double) cur->parent->visit) / cur->visit);
+	}
+};
+
+/**
+ * playout policies, which may propose a move before the uniformly random one, or decide the winner
+ * of a leaf without a playout by evaluate
+ */
+struct random_playout {
+	template<class node_type>
+	static unsigned evaluate(search_context& ctx, const node_type* leaf) { return 0; }
+	template<class node_type>
+	static void start(search_context& ctx, const node_type* leaf) {}
+	static int choose(search_context& ctx, unsigned who, bitboard::bits own) { return -1; }
+	static void played(search_context& ctx, int move) {}
+	static void learn(search_context& ctx, board::piece_type winner) {}
+};
+
+struct lgrf_playout {
+	template<class node_type>
+	static unsigned evaluate(search_context& ctx, const node_type* leaf) { return 0; }
+
+	/**
+	 * collect the moves from the first move below the root down to the leaf
+	 */
+	template<class node_type>
+	static void start(search_context& ctx, const node_type* leaf) {
+		reply_table& replies = ctx.replies;
+		replies.trace.clear();
+		replies.first = static_cast<board::piece_type>(3u - leaf->who);
+		for (const node_type* n = leaf; n->parent; n = n->parent) {
+			replies.trace.push_back(n->move.position().i);
+			replies.first = n->who;
+		}
+		std::reverse(replies.trace.begin(), replies.trace.end());
+	}
+	static int choose(search_context& ctx, unsigned who, bitboard::bits own) {
+		const reply_table& replies = ctx.replies;
+		int move = replies.get(who, replies.trace.size() ? replies.trace.back() : -1);
+		return (move >= 0 && (own & bitboard::bit(move))) ? move : -1;
+	}
+	static void played(search_context& ctx, int move) { ctx.replies.trace.push_back(move); }
+	static void learn(search_context& ctx, board::piece_type winner) { ctx.replies.update(winner); }
+};
+
+/**
+ * the value of the network of inference_service in place of a playout, where the winner is drawn by the value,
+ * so that the nodes keep counting won simulations; without a loaded network, the leaf is played out at random
+ */
+struct network_playout : random_playout {
+	template<class node_type>
+	static unsigned evaluate(search_context& ctx, const node_type* leaf) {
+		const unsigned who = leaf->state.take_turns();
+		if (!leaf->state.legal_moves(who)) return 3u - who;
+		inference_service& service = inference_service::global();
+		if (!service.enabled()) return 0;
+		std::bernoulli_distribution win(service.submit(leaf->state).get().value);
+		return win(ctx.engine) ? who : 3u - who;
+	}
+};
+
+/**
+ * backup policies, which update a node below the root with the winner of a simulation
+ * the wins of a node are counted for the player who moves into it
+ */
+struct rave_backup {
+	template<class node_type>
+	static void update(node_type* cur, board::piece_type winner, search_context& ctx) {
+		search_context::record& rave = ctx.rave(cur->move);
+		cur->visit += 1;
+		rave.visit += 1;
+		if (winner == cur->who) {
+			cur->win += 1;
+			rave.win += 1;
+		}
+	}
+};
+
+struct plain_backup {
+	template<class node_type>
+	static void update(node_type* cur, board::piece_type winner, search_context& ctx) {
+		cur->visit += 1;
+		if (winner == cur->who) cur->win += 1;
+	}
+};
+
+/**
+ * the search over the nodes of node_type, whose board provides legal_moves(black, white) and place(i, who)
+ * as bitboard; with shared_node, several threads search the same tree at once
+ *
+ * each combination of policies compiles into its own kernel, and the colors are template
+ * arguments in Expansion and Simulation, so that there is no dispatch inside the search
+ */
+template<class node_type, class selection, class playout, class backup>
+class mcts {
+public:
+	typedef typename node_type::state_type board_type;
+	typedef typename board_type::bits bits;
+
+	mcts(search_context& ctx, const search_options& opt) : ctx(ctx), opt(opt) {}
+
+public:
+	/**
+	 * search from root until it has simulation= visits, so that the simulations kept in a reused
+	 * subtree count toward the budget
+	 * with compact=N, a tree of its own is laid out again every N simulations, see compact_tree
+	 * with a control given, the search stops early once asked to, and reports to it on the way, see interrupted;
+	 * an infinite control lifts the budget, where sequential halving goes on with UCB after its rounds
+	 */
+	void run_MCTS(node_type* root) {
+		if (!root->expanded()) Expansion(root);
+		if (ctx.control) next_report = std::chrono::steady_clock::now();
+		search(root);
+		if (ctx.control) report(root);
+	}
+
+	void search(node_type* root) {
+		int limit = ctx.control && ctx.control->infinite ? INT_MAX : opt.simulation_count;
+		if (node_type::shared) { // the threads share the budget of the tree
+			while (root->visit < limit && !interrupted(root))
+				run_iteration(root, explore(root));
+			return;
+		}
+		if (ctx.exchange) start_sync(root);
+		if (opt.root_search == "seqhalving") {
+			run_sequential_halving(root);
+			if (limit == opt.simulation_count) return;
+		}
+		for (int i = root->visit; i < limit && !interrupted(root); i++) {
+			run_iteration(root, explore(root));
+			if (opt.compact_interval && (i + 1) % opt.compact_interval == 0) compact_tree(root, opt.compact_visits);
+		}
+	}
+
+	/**
+	 * return whether the search has been asked to stop, and report the root if the interval has passed
+	 */
+	bool interrupted(node_type* root) {
+		if (!ctx.control) return false;
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now >= next_report) {
+			report(root);
+			next_report = now + ctx.control->interval;
+		}
+		return ctx.control->stop.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * copy the statistics of the root children, without those received from other threads, and the most visited
+	 * path below each visited child into the slot of the thread, so that the moves ranked top by the merged
+	 * statistics of all threads have their variations; a shared tree is reported by the first thread alone
+	 */
+	void report(node_type* root) {
+		if (node_type::shared && ctx.slot != 0) return;
+		search_control::snapshot s;
+		s.visit = root->visit;
+		for (node_type* child : root->children) {
+			search_control::child c;
+			c.move = child->move;
+			c.visit = child->visit;
+			c.win = child->win;
+			if (ctx.exchange) {
+				c.visit -= ctx.received[child->move.position().i].visit;
+				c.win -= ctx.received[child->move.position().i].win;
+				s.visit -= ctx.received[child->move.position().i].visit;
+			}
+			if (child->visit) {
+				c.pv.push_back(child->move);
+				for (node_type* cur = child; (cur = principal_child(cur)); ) c.pv.push_back(cur->move);
+			}
+			s.children.push_back(c);
+		}
+		ctx.control->publish(ctx.slot, s);
+	}
+
+	/**
+	 * whether a has more visits than b, or as many visits and a better value
+	 */
+	static bool more_visited(const node_type* a, const node_type* b) {
+		if (a->visit != b->visit) return a->visit > b->visit;
+		return (long long) a->win * b->visit > (long long) b->win * a->visit;
+	}
+
+	/**
+	 * the k most visited children of a node, at most as many as it has
+	 */
+	static std::vector<node_type*> most_visited(node_type* node, int k) {
+		std::vector<node_type*> top(node->children.begin(), node->children.end());
+		k = std::min<int>(std::max(k, 0), top.size());
+		std::partial_sort(top.begin(), top.begin() + k, top.end(), more_visited);
+		top.resize(k);
+		return top;
+	}
+
+	/**
+	 * the next move of a principal variation, the most visited child of a node, or nullptr if it has fewer than
+	 * 2 visits, below which the variation says nothing of the search
+	 */
+	static node_type* principal_child(node_type* node) {
+		if (!node->expanded() || node->children.empty()) return nullptr;
+		node_type* best = *std::min_element(node->children.begin(), node->children.end(), more_visited);
+		return best->visit >= 2 ? best : nullptr;
+	}
+
+	/**
+	 * where the next simulation starts: the least visited of the multipv= most visited root children while it has
+	 * fewer than multipv_visits= visits, so that the k candidates are explored for deep analysis, or else the root
+	 * the candidates are forced only once the root has as many visits as the forcing may take, so that they are
+	 * chosen by the search rather than by the order of the moves
+	 */
+	node_type* explore(node_type* root) {
+		if (!opt.multipv_visits || root->visit < opt.multipv * opt.multipv_visits) return root;
+		std::vector<node_type*> top = most_visited(root, opt.multipv);
+		if (top.empty() || top.back()->visit >= opt.multipv_visits) return root;
+		return top.back();
+	}
+
+	/**
+	 * run one selection-expansion-simulation-backpropagation pass
+	 * the selection starts from 'from', which is either the root or one of its descendants
+	 */
+	void run_iteration(node_type* root, node_type* from) {
+		if (opt.max_nodes && !node_type::shared && tree_size() + bitboard::cells > std::max(opt.max_nodes, retry_size))
+			prune(root, opt.max_nodes * 3 / 4);
+		node_type* best_node = Selection(from);
+		if (Expansion(best_node) && best_node->children.size() != 0) {
+			std::uniform_int_distribution<size_t> uniform(0, best_node->children.size() - 1);
+			best_node = best_node->children[uniform(ctx.engine)];
+		}
+		if (node_type::shared) {
+			for (node_type* cur = best_node; cur != root; cur = cur->parent) cur->visit += 1;
+			root->visit += 1;
+		}
+		board::piece_type winner = Simulation(best_node);
+		BackPropagation(root, best_node, winner);
+		ctx.count += 1;
+		if (ctx.exchange && ++since_sync >= opt.sync_interval) {
+			synchronize(root);
+			since_sync = 0;
+		}
+	}
+
+	/**
+	 * record the statistics that the tree already has before this search, which are not published
+	 */
+	void start_sync(node_type* root) {
+		ctx.base.assign(exchange_buffer::keys, search_context::record());
+		ctx.received.assign(exchange_buffer::keys, search_context::record());
+		visit_shallow(root, [this](int key, const search_context::record& stat) {
+			ctx.base[key] = stat;
+			return search_context::record();
+		});
+	}
+
+	/**
+	 * publish the statistics of the own simulations at the shallow nodes and in the RAVE table,
+	 * and add what the other threads have published since the last synchronization
+	 * the statistics for a node that is not expanded here yet are kept until it is
+	 */
+	void synchronize(node_type* root) {
+		visit_shallow(root, [this, root](int key, const search_context::record& stat) {
+			search_context::record& base = ctx.base[key], & received = ctx.received[key], delta;
+			ctx.exchange->publish(ctx.slot, key, stat.visit - base.visit - received.visit, stat.win - base.win - received.win);
+			int others_visit, others_win;
+			ctx.exchange->collect(ctx.slot, key, others_visit, others_win);
+			delta.visit = others_visit - received.visit;
+			delta.win = others_win - received.win;
+			if (key < bitboard::cells) root->visit += delta.visit;
+			received.visit = others_visit;
+			received.win = others_win;
+			return delta;
+		});
+	}
+
+	/**
+	 * call f(key, statistics) for every node at most two plies below the root and for every RAVE record,
+	 * keyed as in exchange_buffer, and add the returned record to the statistics
+	 */
+	template<class function>
+	void visit_shallow(node_type* root, function f) {
+		auto apply = [&f](int key, node_type* n) {
+			search_context::record stat;
+			stat.visit = n->visit;
+			stat.win = n->win;
+			search_context::record delta = f(key, stat);
+			n->visit += delta.visit;
+			n->win += delta.win;
+		};
+		for (node_type* child : root->children) {
+			int i = child->move.position().i;
+			apply(i, child);
+			for (node_type* grandchild : child->children) {
+				int j = grandchild->move.position().i;
+				apply(bitboard::cells + i * bitboard::cells + j, grandchild);
+			}
+		}
+		for (int c = 0; c < 2; c++) {
+			for (int i = 0; i < bitboard::cells; i++) {
+				search_context::record& rave = ctx.amaf[c][i];
+				search_context::record delta = f(exchange_buffer::shallow + c * bitboard::cells + i, rave);
+				rave.visit += delta.visit;
+				rave.win += delta.win;
+			}
+		}
+	}
+
+	/**
+	 * sequential halving at the root, for small simulation budgets
+	 *
+	 * the candidates are sampled by Gumbel top-k, where the logits come from the RAVE table,
+	 * then the budget is split evenly into log2(k) rounds, each round spreads its share over
+	 * the remaining candidates and keeps the better half of them by win rate
+	 * the nodes below the root are still searched by the selection policy
+	 */
+	void run_sequential_halving(node_type* root) {
+		if (root->children.empty()) return;
+		std::vector<std::pair<double, node_type*> > scored;
+		std::extreme_value_distribution<double> gumbel;
+		for (node_type* child : root->children) {
+			const search_context::record& rave = ctx.rave(child->move);
+			double prior = (rave.win + 1.0) / (rave.visit + 2.0);
+			scored.emplace_back(std::log(prior / (1 - prior)) + gumbel(ctx.engine), child);
+		}
+		size_t k = std::min<size_t>(scored.size(), std::max(opt.candidate_num, 2));
+		std::partial_sort(scored.begin(), scored.begin() + k, scored.end(),
+			[](const std::pair<double, node_type*>& a, const std::pair<double, node_type*>& b) { return a.first > b.first; });
+
+		std::vector<node_type*> candidates;
+		for (size_t i = 0; i < k; i++) candidates.push_back(scored[i].second);
+		int rounds = std::max(1, int(std::ceil(std::log2(candidates.size()))));
+		int budget = opt.simulation_count - root->visit;
+		for (int r = 0; candidates.size() > 1 && budget > 0; r++) {
+			int per_move = std::max(1, budget / (int(candidates.size()) * std::max(1, rounds - r)));
+			for (node_type* child : candidates) {
+				for (int i = 0; i < per_move; i++) {
+					if (interrupted(root)) return;
+					run_iteration(root, child);
+				}
+				budget -= per_move;
+			}
+			std::stable_sort(candidates.begin(), candidates.end(), [](node_type* a, node_type* b) {
+				return (double) a->win / std::max<int>(a->visit, 1) > (double) b->win / std::max<int>(b->visit, 1);
+			});
+			candidates.resize((candidates.size() + 1) / 2);
+		}
+	}
+
+	/**
+	 * descend from n by the selection policy to a node that is not expanded, which may be one
+	 * that another thread is expanding, or to a terminal node
+	 */
+	node_type* Selection(node_type* n) {
+		node_type* cur = n;
+		while (cur->expanded() && !cur->children.empty()) {
+			double max_value = 0;
+			int select_idx = 0;
+			for (size_t i = 0; i < cur->children.size(); ++i) {
+				double ucb = selection::value(cur->children[i], ctx, opt);
+				if (max_value < ucb) {
+					max_value = ucb;
+					select_idx = i;
+				}
+			}
+			cur = cur->children[select_idx];
+		}
+		return cur;
+	}
+
+	/**
+	 * expand the node, return false if it has been expanded or another thread is expanding it,
+	 * or if the tree is too large to take the children of a node below the root
+	 *
+	 * the thread that wins the CAS on the state word from unexpanded to expanding builds the children
+	 * off to the side, then publishes them with a release store of expanded; the other threads never wait,
+	 * they simulate from the node instead and take another path next time
+	 */
+	bool Expansion(node_type* parent_node) {
+		if (opt.max_nodes && parent_node->parent && tree_size() + bitboard::cells > opt.max_nodes) return false;
+		int state = node_type::unexpanded;
+		if (!parent_node->expansion.compare_exchange_strong(state, node_type::expanding, std::memory_order_acquire))
+			return false;
+		std::vector<node_type*> children;
+		if (parent_node->who == board::black) Expansion<board::white>(parent_node, children);
+		else Expansion<board::black>(parent_node, children);
+		add_nodes(children.size());
+		parent_node->children.swap(children);
+		parent_node->expansion.store(node_type::expanded_state, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * the number of nodes in the tree, as counted by the player before the search and by the expansions since
+	 */
+	long tree_size() const {
+		return node_type::shared ? ctx.shared_nodes->load(std::memory_order_relaxed) : ctx.nodes;
+	}
+	void add_nodes(long n) {
+		if (node_type::shared) ctx.shared_nodes->fetch_add(n, std::memory_order_relaxed);
+		else ctx.nodes += n;
+	}
+
+	/**
+	 * free the subtrees below the least visited nodes until the tree has at most target nodes
+	 *
+	 * a pruned node keeps its statistics and becomes a leaf again, which may be expanded later;
+	 * the nodes up to the grandchildren of the root are never pruned, so that their children stay for
+	 * the synchronization, and a shared tree is never pruned, since other threads may be reading it
+	 * a node may have more visits than its parent, e.g., when seeded by cache=, so that a node is skipped
+	 * once any of its ancestors has been pruned, as it is freed by then
+	 * if the target cannot be reached, a warning is printed once, and pruning waits until the tree has
+	 * grown by a quarter of max_nodes, instead of walking the whole tree again at every simulation
+	 */
+	void prune(node_type* root, long target) {
+		std::vector<node_type*> expanded;
+		std::vector<int> above; // the index of the nearest ancestor in expanded, or -1
+		std::vector<std::pair<node_type*, std::pair<int, int> > > stack = { { root, { 0, -1 } } }; // with depth and above
+		while (stack.size()) {
+			node_type* n = stack.back().first;
+			int depth = stack.back().second.first, parent = stack.back().second.second;
+			stack.pop_back();
+			if (depth >= 2 && n->children.size()) {
+				expanded.push_back(n);
+				above.push_back(parent);
+				parent = expanded.size() - 1;
+			}
+			for (node_type* child : n->children) stack.push_back({ child, { depth + 1, parent } });
+		}
+		std::vector<int> order(expanded.size());
+		for (size_t i = 0; i < order.size(); i++) order[i] = i;
+		std::sort(order.begin(), order.end(), [&](int a, int b) {
+			return expanded[a]->visit != expanded[b]->visit ? expanded[a]->visit < expanded[b]->visit : a > b;
+		});
+		std::vector<bool> pruned(expanded.size());
+		for (size_t k = 0; k < order.size() && tree_size() > target; k++) {
+			int i = order[k];
+			bool gone = false;
+			for (int a = above[i]; a >= 0 && !gone; a = above[a]) gone = pruned[a];
+			if (gone) continue;
+			node_type* n = expanded[i];
+			long freed = 0;
+			for (node_type* child : n->children) freed += free_tree(child);
+			n->children.clear();
+			n->children.shrink_to_fit();
+			n->expansion.store(node_type::unexpanded, std::memory_order_relaxed);
+			add_nodes(-freed);
+			pruned[i] = true;
+		}
+		retry_size = 0;
+		if (tree_size() > target) {
+			retry_size = tree_size() + opt.max_nodes / 4;
+			static std::once_flag warned;
+			std::call_once(warned, [&]() {
+				std::cerr << "max_mem= cannot be kept, the top two plies alone have " << tree_size() << " nodes" << std::endl;
+			});
+		}
+	}
+
+	/**
+	 * free the subtree and return its number of nodes
+	 */
+	static long free_tree(node_type* n) {
+		long freed = 1;
+		for (auto it = n->children.rbegin(); it != n->children.rend(); ++it) freed += free_tree(*it);
+		delete n;
+		return freed;
+	}
+
+	/**
+	 * create the children of the legal moves of who, which start from the statistics of their positions
+	 * in the value cache with cache= given, see seed_node
+	 * the cache is only looked up below a seeded node, since the cache keeps a node only along with its parent
+	 */
+	template<unsigned who>
+	void Expansion(node_type* parent_node, std::vector<node_type*>& children) {
+		bits black, white;
+		parent_node->state.legal_moves(black, white);
+		bits moves = (who == board::black ? black : white);
+		children.reserve(board_type::count(moves));
+		bool cached = opt.cache_prior && parent_node->cached;
+		uint64_t keys[8];
+		if (cached) value_cache::keys(parent_node->state, who, keys);
+		for (; moves; moves &= moves - 1) {
+			int i = board_type::lowest(moves);
+			node_type* child_node = new node_type;
+			child_node->state = parent_node->state;
+			child_node->state.place(i, who);
+			child_node->parent = parent_node;
+			child_node->move = action::place(i, who);
+			child_node->who = static_cast<board::piece_type>(who);
+			if (cached) seed_node(child_node, value_cache::key(keys, i), opt.cache_prior);
+			children.emplace_back(child_node);
+		}
+	}
+
+	/**
+	 * play out from the leaf until the side to move has no legal move, and return the winner
+	 */
+	board::piece_type Simulation(node_type* leaf) {
+		if (unsigned winner = playout::evaluate(ctx, leaf)) return static_cast<board::piece_type>(winner);
+		playout::start(ctx, leaf);
+		board_type state = leaf->state;
+		if (leaf->who == board::black) return Simulation<board::white>(state);
+		else return Simulation<board::black>(state);
+	}
+
+	template<unsigned who>
+	board::piece_type Simulation(board_type& state) {
+		while (true) {
+			if (unsigned winner = Simulation_step<who>(state)) return static_cast<board::piece_type>(winner);
+			if (unsigned winner = Simulation_step<3u - who>(state)) return static_cast<board::piece_type>(winner);
+		}
+	}
+
+	/**
+	 * make one playout move of who, or return the winner if the playout is over
+	 *
+	 * the move is uniformly random unless the playout policy proposes a legal one
+	 * with truncate= given, the playout stops early once the static mobility evaluation reports
+	 * a margin of at least that many private points, or when no contested point is left
+	 * with tactics= given, a move that wins at once is always played, and a move that loses at once
+	 * is replaced by a checked safe move, see check_tactics
+	 */
+	template<unsigned who>
+	unsigned Simulation_step(board_type& state) {
+		const unsigned other = 3u - who;
+		bits black, white;
+		state.legal_moves(black, white);
+		bits own = (who == board::black ? black : white);
+		bits opp = (who == board::black ? white : black);
+		if (!own) return other;
+		if (opt.truncate_margin) {
+			int contested;
+			int margin = board_type::evaluate(own, opp, &contested);
+			if (margin >= opt.truncate_margin) return who;
+			if (-margin >= opt.truncate_margin) return other;
+			if (!contested) return margin > 0 ? who : other;
+		}
+		int move = -1;
+		bits safe = 0, losing = 0;
+		if (opt.tactics_budget) {
+			move = check_tactics<who>(state, own, opp, safe, losing);
+		}
+		if (move < 0) move = playout::choose(ctx, who, own);
+		if (move < 0) {
+			std::uniform_int_distribution<int> uniform(0, board_type::count(own) - 1);
+			move = board_type::select(own, uniform(ctx.engine));
+		}
+		if ((losing & board_type::bit(move)) && safe) {
+			std::uniform_int_distribution<int> uniform(0, board_type::count(safe) - 1);
+			move = board_type::select(safe, uniform(ctx.engine));
+		}
+		state.place(move, who);
+		playout::played(ctx, move);
+		return 0;
+	}
+
+	/**
+	 * one-ply tactical checks for who to move, given the legal moves own and opp of both sides
+	 *
+	 * the checks only run when either side is down to at most tactics= legal moves, since no single
+	 * move decides the game before that, and at most tactics= moves are tried, the moves that the
+	 * opponent can also play first
+	 * a move wins at once if the opponent has no legal move after it, and loses at once if it leaves
+	 * who with at most one legal move, which the opponent can also take
+	 * return the winning move, or -1 with the tried moves split into safe and losing
+	 */
+	template<unsigned who>
+	int check_tactics(const board_type& state, bits own, bits opp, bits& safe, bits& losing) {
+		int budget = opt.tactics_budget;
+		if (board_type::count(own) > budget && board_type::count(opp) > budget) return -1;
+		bits order[2] = { own & opp, own & ~opp };
+		for (int k = 0; k < 2; k++) {
+			for (bits rest = order[k]; rest && budget; rest &= rest - 1, budget--) {
+				int move = board_type::lowest(rest);
+				board_type after = state;
+				after.place(move, who);
+				bits black, white;
+				after.legal_moves(black, white);
+				bits next_own = (who == board::black ? black : white);
+				bits next_opp = (who == board::black ? white : black);
+				if (!next_opp) return move;
+				if (!(next_own & ~next_opp) && board_type::count(next_own) <= 1) losing |= board_type::bit(move);
+				else safe |= board_type::bit(move);
+			}
+		}
+		return -1;
+	}
+
+	/**
+	 * update the nodes from cur up to root with the winner
+	 * with a shared tree, the visits on the path have been added before the simulation as a virtual loss,
+	 * which steers the other threads away from the path, so that they are taken back here
+	 */
+	void BackPropagation(node_type* root, node_type* cur, board::piece_type winner) {
+		for (; cur != root; cur = cur->parent) {
+			backup::update(cur, winner, ctx);
+			if (node_type::shared) cur->visit -= 1;
+		}
+		if (node_type::shared) root->visit -= 1;
+		root->visit += 1;
+		if (winner == root->who) root->win += 1;
+		playout::learn(ctx, winner);
+	}
+
+private:
+	search_context& ctx;
+	const search_options& opt;
+	int since_sync = 0;
+	long retry_size = 0; // the size to wait for before pruning again, after a prune fell short of its target
+	std::chrono::steady_clock::time_point next_report;
+};
@@ -0,0 +1,566 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * network.h: Small policy and value network, and a service that evaluates it in batches
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <array>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <random>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <chrono>
+#include "board.h"
+#include "bitboard.h"
+
+/**
+ * a small convolutional network that gives the move probabilities and the value of a position
+ *
+ * the input has 7 planes from the view of the side to move: own stones, opponent stones, empty cells,
+ * hollow cells, own legal moves, opponent legal moves, and ones, which mark the edge against the zero padding
+ * the trunk is a 3x3 convolution to filters= channels, followed by layers-1 residual 3x3 convolutions
+ * h + relu(conv(h)); the policy head maps the channels of each cell to its logit, and the value head maps
+ * the average channels over the board to the logit of the probability that the side to move wins
+ *
+ * the activations are kept cell by cell with the channels last, so that a convolution over a batch is one
+ * matrix multiply of the 3x3 windows of all cells of all boards by the weights
+ * the weight file is a header followed by params() as 32-bit floats
+ */
+class network {
+public:
+	enum { planes = 7, cells = bitboard::cells, window = 9 };
+	struct header {
+		char magic[8];
+		uint32_t version;
+		uint32_t filters;
+		uint32_t layers;
+		uint32_t reserved;
+	};
+
+	/**
+	 * the outputs for a position, where the policy is over the legal moves of the side to move
+	 */
+	struct evaluation {
+		float value;
+		float policy[cells];
+	};
+
+	/**
+	 * the buffers of a batch, which keep the activations of every layer for the backward pass
+	 */
+	struct workspace {
+		int batch = 0;
+		std::vector<std::vector<float> > cols; // the 3x3 windows of the input of each layer
+		std::vector<std::vector<float> > relu; // the rectified convolution of each layer
+		std::vector<std::vector<float> > act; // the input of each layer, and the output of the trunk
+		std::vector<float> pooled, policy, value; // the average channels, and the logits of both heads
+		std::vector<float> delta, conv, delta_cols, transposed; // the gradients of backward
+	};
+
+	network(int filters = 32, int layers = 4, uint64_t seed = 1) : filters(filters), layers(layers) {
+		size_t size = 0;
+		for (int l = 0; l < layers; l++) {
+			offset.push_back(size);
+			size += (l ? filters : planes) * window * filters + filters;
+		}
+		offset.push_back(size); // the policy head
+		offset.push_back(size + filters + 1); // the value head
+		param.assign(size + 2 * (filters + 1), 0);
+
+		std::mt19937_64 engine(seed);
+		for (int l = 0; l < layers; l++) { // He initialization, with the residual layers scaled down
+			int fan_in = (l ? filters : planes) * window;
+			std::normal_distribution<float> normal(0, std::sqrt(2.0f / fan_in) * (l ? 0.5f : 1.0f));
+			for (int i = 0; i < fan_in * filters; i++) weight(l)[i] = normal(engine);
+		}
+		std::normal_distribution<float> head(0, std::sqrt(1.0f / filters));
+		for (int i = 0; i < filters; i++) policy_weight()[i] = head(engine);
+		for (int i = 0; i < filters; i++) value_weight()[i] = head(engine);
+	}
+
+public:
+	int width() const { return filters; }
+	int depth() const { return layers; }
+
+	std::vector<float>& params() { return param; }
+	const std::vector<float>& params() const { return param; }
+
+	float* weight(int l) { return &param[offset[l]]; }
+	float* bias(int l) { return &param[offset[l]] + (l ? filters : planes) * window * filters; }
+	float* policy_weight() { return &param[offset[layers]]; }
+	float* value_weight() { return &param[offset[layers + 1]]; }
+	const float* weight(int l) const { return &param[offset[l]]; }
+	const float* bias(int l) const { return &param[offset[l]] + (l ? filters : planes) * window * filters; }
+	const float* policy_weight() const { return &param[offset[layers]]; }
+	const float* value_weight() const { return &param[offset[layers + 1]]; }
+
+	/**
+	 * load the weights from a file, or keep the current ones and return false if it is not a network
+	 */
+	bool load(const std::string& path) {
+		std::ifstream in(path, std::ios::in | std::ios::binary);
+		header h = {};
+		if (!in.read(reinterpret_cast<char*>(&h), sizeof(h)) || std::memcmp(h.magic, magic(), 8) != 0
+				|| h.version != version || h.filters == 0 || h.filters > 1024 || h.layers == 0 || h.layers > 64) {
+			std::cerr << "invalid network " << path << std::endl;
+			return false;
+		}
+		network next(h.filters, h.layers);
+		if (!in.read(reinterpret_cast<char*>(next.param.data()), next.param.size() * sizeof(float))) {
+			std::cerr << "invalid network " << path << std::endl;
+			return false;
+		}
+		*this = next;
+		return true;
+	}
+
+	/**
+	 * save the weights, written aside and renamed over the old file, so that a reader never sees half of them
+	 */
+	bool save(const std::string& path) const {
+		header h = {};
+		std::memcpy(h.magic, magic(), 8);
+		h.version = version;
+		h.filters = filters;
+		h.layers = layers;
+		std::string temp = path + ".tmp";
+		std::ofstream out(temp, std::ios::out | std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+		out.write(reinterpret_cast<const char*>(param.data()), param.size() * sizeof(float));
+		out.close();
+		return out.good() && std::rename(temp.c_str(), path.c_str()) == 0;
+	}
+
+public:
+	/**
+	 * write the input planes of a position, cell by cell, from the view of its side to move
+	 */
+	static void features(const bitboard& state, float* x) {
+		unsigned who = state.take_turns();
+		bitboard::bits black, white;
+		state.legal_moves(black, white);
+		bitboard::bits own = state.stones(who), opp = state.stones(3u - who), space = state.empty();
+		bitboard::bits own_legal = who == board::black ? black : white, opp_legal = who == board::black ? white : black;
+		bitboard::bits hollow = bitboard::full() & ~(own | opp | space);
+		const bitboard::bits plane[planes - 1] = { own, opp, space, hollow, own_legal, opp_legal };
+		for (int i = 0; i < cells; i++, x += planes) {
+			for (int p = 0; p < planes - 1; p++) x[p] = (plane[p] >> i) & 1 ? 1.0f : 0.0f;
+			x[planes - 1] = 1.0f;
+		}
+	}
+
+	/**
+	 * run the network on a batch of inputs given by features, and leave the logits in the workspace
+	 */
+	void forward(workspace& w, const float* input, int batch) const {
+		const int rows = batch * cells;
+		w.batch = batch;
+		w.cols.resize(layers);
+		w.relu.resize(layers);
+		w.act.resize(layers + 1);
+		w.act[0].assign(input, input + rows * planes);
+		for (int l = 0; l < layers; l++) {
+			const int channels = l ? filters : planes;
+			windows(w.act[l].data(), channels, batch, w.cols[l]);
+			std::vector<float>& out = w.relu[l];
+			out.resize(rows * filters);
+			for (int r = 0; r < rows; r++) std::copy(bias(l), bias(l) + filters, &out[r * filters]);
+			gemm(w.cols[l].data(), weight(l), out.data(), rows, channels * window, filters);
+			for (float& v : out) v = std::max(v, 0.0f);
+			w.act[l + 1] = out;
+			if (l) for (int i = 0; i < rows * filters; i++) w.act[l + 1][i] += w.act[l][i];
+		}
+
+		const std::vector<float>& trunk = w.act[layers];
+		w.policy.resize(rows);
+		w.pooled.assign(batch * filters, 0);
+		w.value.resize(batch);
+		for (int r = 0; r < rows; r++) {
+			const float* h = &trunk[r * filters];
+			float* pooled = &w.pooled[(r / cells) * filters];
+			float logit = policy_weight()[filters];
+			for (int c = 0; c < filters; c++) {
+				logit += h[c] * policy_weight()[c];
+				pooled[c] += h[c] * (1.0f / cells);
+			}
+			w.policy[r] = logit;
+		}
+		for (int b = 0; b < batch; b++) {
+			float logit = value_weight()[filters];
+			for (int c = 0; c < filters; c++) logit += w.pooled[b * filters + c] * value_weight()[c];
+			w.value[b] = logit;
+		}
+	}
+
+	/**
+	 * evaluate a batch of inputs given by features, with the policy normalized over the own legal moves
+	 */
+	void evaluate(workspace& w, const float* input, int batch, evaluation* out) const {
+		forward(w, input, batch);
+		for (int b = 0; b < batch; b++) {
+			const float* x = input + b * cells * planes;
+			const float* logit = &w.policy[b * cells];
+			out[b].value = 1.0f / (1.0f + std::exp(-w.value[b]));
+			float max = -INFINITY, sum = 0;
+			for (int i = 0; i < cells; i++) if (x[i * planes + 4] > 0) max = std::max(max, logit[i]);
+			for (int i = 0; i < cells; i++) {
+				out[b].policy[i] = x[i * planes + 4] > 0 ? std::exp(logit[i] - max) : 0.0f;
+				sum += out[b].policy[i];
+			}
+			if (sum > 0) for (float& p : out[b].policy) p /= sum;
+		}
+	}
+
+	/**
+	 * add the gradients of the loss of the batch last run by forward to grad, laid out as params(), and return
+	 * the two parts of the loss, both summed over the batch
+	 *
+	 * the policy loss is the cross entropy of the policy over the own legal moves against the target
+	 * distribution of each position, and the value loss that of the value against the target fraction of wins,
+	 * whose gradient is scaled by value_scale
+	 */
+	std::pair<double, double> backward(workspace& w, const float* input, const float* policy, const float* value,
+			std::vector<float>& grad, float value_scale = 1) const {
+		const int rows = w.batch * cells;
+		const std::vector<float>& trunk = w.act[layers];
+		std::vector<float>& delta = w.delta; // of the activations, from the output of the trunk down
+		delta.assign(rows * filters, 0);
+		double policy_loss = 0, value_loss = 0;
+		float* policy_grad = &grad[offset[layers]];
+		float* value_grad = &grad[offset[layers + 1]];
+
+		for (int b = 0; b < w.batch; b++) {
+			const float* x = input + b * cells * planes;
+			const float* logit = &w.policy[b * cells];
+			const float* target = policy + b * cells;
+			float max = -INFINITY, sum = 0;
+			for (int i = 0; i < cells; i++) if (x[i * planes + 4] > 0) max = std::max(max, logit[i]);
+			for (int i = 0; i < cells; i++) if (x[i * planes + 4] > 0) sum += std::exp(logit[i] - max);
+			for (int i = 0; i < cells; i++) {
+				if (!(x[i * planes + 4] > 0)) continue;
+				const float log_p = logit[i] - max - std::log(sum);
+				if (target[i] > 0) policy_loss -= target[i] * log_p;
+				const float d = std::exp(log_p) - target[i];
+				const float* h = &trunk[(b * cells + i) * filters];
+				float* dh = &delta[(b * cells + i) * filters];
+				for (int c = 0; c < filters; c++) {
+					policy_grad[c] += d * h[c];
+					dh[c] += d * policy_weight()[c];
+				}
+				policy_grad[filters] += d;
+			}
+
+			const float v = 1.0f / (1.0f + std::exp(-w.value[b])), z = value[b];
+			value_loss -= z * std::log(std::max(v, 1e-7f)) + (1 - z) * std::log(std::max(1 - v, 1e-7f));
+			const float d = (v - z) * value_scale;
+			for (int c = 0; c < filters; c++) value_grad[c] += d * w.pooled[b * filters + c];
+			value_grad[filters] += d;
+			for (int i = 0; i < cells; i++) {
+				float* dh = &delta[(b * cells + i) * filters];
+				for (int c = 0; c < filters; c++) dh[c] += d * value_weight()[c] * (1.0f / cells);
+			}
+		}
+
+		static const std::vector<std::array<int, window> > around = neighborhoods();
+		for (int l = layers - 1; l >= 0; l--) {
+			const int channels = l ? filters : planes, k = channels * window;
+			std::vector<float>& conv = w.conv; // the gradient of the convolution before the rectifier
+			conv.resize(rows * filters);
+			for (int i = 0; i < rows * filters; i++) conv[i] = w.relu[l][i] > 0 ? delta[i] : 0;
+			float* weight_grad = &grad[offset[l]];
+			float* bias_grad = weight_grad + k * filters;
+			gemm_tn(w.cols[l].data(), conv.data(), weight_grad, rows, k, filters);
+			for (int r = 0; r < rows; r++)
+				for (int c = 0; c < filters; c++) bias_grad[c] += conv[r * filters + c];
+			if (l == 0) break;
+
+			// the residual layer passes delta through, and adds the gradient of its windows back to their cells
+			std::vector<float>& transposed = w.transposed;
+			transposed.resize(k * filters);
+			for (int i = 0; i < k; i++)
+				for (int c = 0; c < filters; c++) transposed[c * k + i] = weight(l)[i * filters + c];
+			w.delta_cols.assign(rows * k, 0);
+			gemm(conv.data(), transposed.data(), w.delta_cols.data(), rows, filters, k);
+			const float* dcol = w.delta_cols.data();
+			for (int b = 0; b < w.batch; b++) {
+				float* board = &delta[b * cells * channels];
+				for (int i = 0; i < cells; i++) {
+					for (int n = 0; n < window; n++, dcol += channels) {
+						if (around[i][n] < 0) continue;
+						float* dh = board + around[i][n] * channels;
+						for (int c = 0; c < channels; c++) dh[c] += dcol[c];
+					}
+				}
+			}
+		}
+		return std::make_pair(policy_loss, value_loss);
+	}
+
+public:
+	/**
+	 * c += a * b, where a is m x k, b is k x n and c is m x n, all row-major
+	 *
+	 * four rows of c are updated together, so that each row of b is loaded once for all of them,
+	 * and the inner loop over the columns is vectorized by the compiler
+	 */
+	static void gemm(const float* a, const float* b, float* c, int m, int k, int n) {
+		int i = 0;
+		for (; i + 4 <= m; i += 4) {
+			float* __restrict__ c0 = c + i * n;
+			float* __restrict__ c1 = c0 + n;
+			float* __restrict__ c2 = c1 + n;
+			float* __restrict__ c3 = c2 + n;
+			const float* a0 = a + i * k;
+			for (int p = 0; p < k; p++) {
+				const float* __restrict__ row = b + p * n;
+				const float x0 = a0[p], x1 = a0[k + p], x2 = a0[2 * k + p], x3 = a0[3 * k + p];
+				for (int j = 0; j < n; j++) {
+					const float v = row[j];
+					c0[j] += x0 * v;
+					c1[j] += x1 * v;
+					c2[j] += x2 * v;
+					c3[j] += x3 * v;
+				}
+			}
+		}
+		for (; i < m; i++) {
+			float* __restrict__ c0 = c + i * n;
+			for (int p = 0; p < k; p++) {
+				const float* __restrict__ row = b + p * n;
+				const float x0 = a[i * k + p];
+				for (int j = 0; j < n; j++) c0[j] += x0 * row[j];
+			}
+		}
+	}
+
+	/**
+	 * c += a^T * b, where a is m x k, b is m x n and c is k x n, all row-major, skipping the zeros of a,
+	 * which are many in the windows of the input planes and at the edge
+	 */
+	static void gemm_tn(const float* a, const float* b, float* c, int m, int k, int n) {
+		for (int i = 0; i < m; i++) {
+			const float* __restrict__ row = b + i * n;
+			for (int p = 0; p < k; p++) {
+				const float x = a[i * k + p];
+				if (x == 0) continue;
+				float* __restrict__ out = c + p * n;
+				for (int j = 0; j < n; j++) out[j] += x * row[j];
+			}
+		}
+	}
+
+	/**
+	 * gather the 3x3 windows of every cell of a batch of activations into rows of window * channels,
+	 * with zeros outside the board
+	 */
+	static void windows(const float* act, int channels, int batch, std::vector<float>& cols) {
+		static const std::vector<std::array<int, window> > around = neighborhoods();
+		cols.assign(size_t(batch) * cells * window * channels, 0);
+		float* out = cols.data();
+		for (int b = 0; b < batch; b++) {
+			const float* board = act + b * cells * channels;
+			for (int i = 0; i < cells; i++) {
+				for (int k = 0; k < window; k++, out += channels)
+					if (around[i][k] >= 0) std::copy(board + around[i][k] * channels, board + (around[i][k] + 1) * channels, out);
+			}
+		}
+	}
+
+	/**
+	 * the cells in the 3x3 window of each cell, or -1 outside the board
+	 */
+	static std::vector<std::array<int, window> > neighborhoods() {
+		std::vector<std::array<int, window> > around(cells);
+		for (int x = 0; x < board::size_x; x++) {
+			for (int y = 0; y < board::size_y; y++) {
+				for (int k = 0; k < window; k++) {
+					int u = x + k / 3 - 1, v = y + k % 3 - 1;
+					bool inside = u >= 0 && u < board::size_x && v >= 0 && v < board::size_y;
+					around[x * board::size_y + y][k] = inside ? u * board::size_y + v : -1;
+				}
+			}
+		}
+		return around;
+	}
+
+private:
+	static const char* magic() { return "NOGONET1"; }
+	enum { version = 1 };
+
+	int filters;
+	int layers;
+	std::vector<size_t> offset; // of the weights of each layer, then of the policy and the value head
+	std::vector<float> param;
+};
+
+/**
+ * the network of the process, evaluated for all players and threads in batches on a thread of its own
+ *
+ * a search thread submits its leaf and waits on the future; the requests are queued, and a batch is run once
+ * it has batch= requests, or one for each attached search thread, since none of them can submit another
+ * before its result, or when its first request has waited batch_wait= microseconds
+ * with many games in flight, e.g., --parallel self-play, the leaves of all games share the batches
+ * a batch is split among batch_threads= threads, one for each CPU by default, at least 4 positions each, so that
+ * the cores left idle by the waiting search threads evaluate it together
+ */
+class inference_service {
+public:
+	static inference_service& global() {
+		static inference_service service;
+		return service;
+	}
+	~inference_service() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			quit = true;
+		}
+		wake.notify_all();
+		if (worker.joinable()) worker.join();
+	}
+
+	/**
+	 * load the network of a file for the process, once for each path
+	 */
+	bool load(const std::string& path) {
+		std::lock_guard<std::mutex> guard(lock);
+		if (path == loaded) return true;
+		std::shared_ptr<network> next = std::make_shared<network>();
+		if (!next->load(path)) return false;
+		model = next;
+		loaded = path;
+		if (!worker.joinable()) worker = std::thread(&inference_service::serve, this);
+		return true;
+	}
+	bool enabled() const {
+		std::lock_guard<std::mutex> guard(lock);
+		return model != nullptr;
+	}
+
+	void configure(int batch, int wait, int threads = 0) {
+		std::lock_guard<std::mutex> guard(lock);
+		max_batch = std::max(1, batch);
+		max_wait = std::chrono::microseconds(std::max(0, wait));
+		if (threads > 0) max_threads = threads;
+	}
+
+	/**
+	 * queue a position for the next batch, the network should be loaded
+	 */
+	std::future<network::evaluation> submit(const bitboard& state) {
+		std::unique_ptr<request> r(new request);
+		network::features(state, r->input);
+		std::future<network::evaluation> result = r->result.get_future();
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			r->since = std::chrono::steady_clock::now();
+			queue.push_back(std::move(r));
+		}
+		wake.notify_one();
+		return result;
+	}
+
+	/**
+	 * the threads that wait on their submitted positions, counted while attached by a client
+	 */
+	class client {
+	public:
+		client(int threads) : threads(threads) { if (threads) global().attach(threads); }
+		~client() { if (threads) global().detach(threads); }
+	private:
+		int threads;
+	};
+	void attach(int threads) {
+		std::lock_guard<std::mutex> guard(lock);
+		clients += threads;
+	}
+	void detach(int threads) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			clients -= threads;
+		}
+		wake.notify_one();
+	}
+
+	size_t evaluated() const { return positions; }
+	size_t batches() const { return runs; }
+
+private:
+	struct request {
+		float input[network::cells * network::planes];
+		std::promise<network::evaluation> result;
+		std::chrono::steady_clock::time_point since;
+	};
+
+	inference_service() = default;
+
+	size_t target() const { return std::max(1, std::min(max_batch, clients)); }
+
+	void serve() {
+		std::vector<network::workspace> w;
+		std::vector<std::unique_ptr<request> > batch;
+		std::vector<float> input;
+		std::vector<network::evaluation> out;
+		std::unique_lock<std::mutex> guard(lock);
+		while (true) {
+			wake.wait(guard, [this]() { return quit || queue.size(); });
+			if (queue.empty()) return;
+			std::chrono::steady_clock::time_point deadline = queue.front()->since + max_wait;
+			while (!quit && queue.size() < target()) {
+				if (wake.wait_until(guard, deadline) == std::cv_status::timeout) break;
+			}
+			size_t n = std::min<size_t>(queue.size(), max_batch);
+			batch.clear();
+			for (size_t i = 0; i < n; i++) {
+				batch.push_back(std::move(queue.front()));
+				queue.pop_front();
+			}
+			std::shared_ptr<const network> net = model;
+			const int parts = std::max(1, std::min<int>(max_threads, n / 4));
+			guard.unlock();
+
+			const size_t size = network::cells * network::planes;
+			input.resize(n * size);
+			out.resize(n);
+			w.resize(parts);
+			for (size_t i = 0; i < n; i++) std::copy(batch[i]->input, batch[i]->input + size, &input[i * size]);
+			#pragma omp parallel for num_threads(parts) if(parts > 1)
+			for (int t = 0; t < parts; t++) {
+				size_t begin = n * t / parts, end = n * (t + 1) / parts;
+				net->evaluate(w[t], &input[begin * size], end - begin, &out[begin]);
+			}
+			for (size_t i = 0; i < n; i++) batch[i]->result.set_value(out[i]);
+			positions += n;
+			runs += 1;
+			guard.lock();
+		}
+	}
+
+	mutable std::mutex lock;
+	std::condition_variable wake;
+	std::deque<std::unique_ptr<request> > queue;
+	std::shared_ptr<const network> model;
+	std::string loaded;
+	std::thread worker;
+	int max_batch = 64;
+	int max_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::chrono::microseconds max_wait{1000};
+	int clients = 0;
+	bool quit = false;
+	std::atomic<size_t> positions{0}, runs{0};
+};
@@ -11,98 +11,199 @@
 #include <fstream>
 #include <iterator>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <streambuf>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include "board.h"
 #include "action.h"
 #include "agent.h"
 #include "episode.h"
 #include "statistics.h"
+#include "dataset.h"
+#include "trainer.h"
 
-int main(int argc, const char* argv[]) {
-	std::cout << "HollowNoGo-Demo: ";
-	std::copy(argv, argv + argc, std::ostream_iterator<const char*>(std::cout, " "));
-	std::cout << std::endl << std::endl;
-
-	size_t total = 1000, block = 0, limit = 0;
-	std::string black_args, white_args;
-	std::string load_path, save_path;
-	std::string name = "TCG-HollowNoGo-Demo", version = "2022"; // for GTP shell
-	bool shell = false;
-	for (int i = 1; i < argc; i++) {
-		std::string arg = argv[i];
-		auto match_arg = [&](std::string flag) -> bool {
-			auto it = arg.find_first_not_of('-');
-			return arg.find(flag, it) == it;
-		};
-		auto next_opt = [&]() -> std::string {
-			auto it = arg.find('=') + 1;
-			return it ? arg.substr(it) : argv[++i];
-		};
-		if (match_arg("total")) {
-			total = std::stoull(next_opt());
-		} else if (match_arg("block")) {
-			block = std::stoull(next_opt());
-		} else if (match_arg("limit")) {
-			limit = std::stoull(next_opt());
-		} else if (match_arg("black")) {
-			black_args = next_opt();
-		} else if (match_arg("white")) {
-			white_args = next_opt();
-		} else if (match_arg("load")) {
-			load_path = next_opt();
-		} else if (match_arg("save")) {
-			save_path = next_opt();
-		} else if (match_arg("name")) {
-			name = next_opt();
-		} else if (match_arg("version")) {
-			version = next_opt();
-		} else if (match_arg("shell")) {
-			shell = true;
-		}
+/**
+ * the lines of an input stream, read by a thread of its own, so that the shell can wait for the next
+ * command with a timeout while a search runs
+ * the reader is never joined, as it may block on the stream until the process ends, and owns the lines
+ * and the stream with it
+ */
+class line_reader {
+public:
+	static std::shared_ptr<line_reader> start(std::shared_ptr<std::istream> in) {
+		std::shared_ptr<line_reader> reader(new line_reader);
+		std::thread([reader, in]() {
+			for (std::string line; std::getline(*in, line); ) {
+				std::lock_guard<std::mutex> guard(reader->lock);
+				reader->lines.push_back(line);
+				reader->ready.notify_all();
+			}
+			std::lock_guard<std::mutex> guard(reader->lock);
+			reader->closed = true;
+			reader->ready.notify_all();
+		}).detach();
+		return reader;
 	}
 
-	statistics stats(total, block, limit);
+	/**
+	 * take the next line, or return false at the end of the stream
+	 */
+	bool next(std::string& line) {
+		std::unique_lock<std::mutex> guard(lock);
+		ready.wait(guard, [this]() { return lines.size() || closed; });
+		if (lines.empty()) return false;
+		line = lines.front();
+		lines.pop_front();
+		return true;
+	}
 
-	if (load_path.size()) {
-		std::ifstream in(load_path, std::ios::in);
-		in >> stats;
-		in.close();
-		if (stats.is_finished()) stats.summary();
+	/**
+	 * wait until a line is pending or the stream ends, at most for the timeout, and return whether it is so
+	 */
+	bool wait_for(std::chrono::milliseconds timeout) {
+		std::unique_lock<std::mutex> guard(lock);
+		return ready.wait_for(guard, timeout, [this]() { return lines.size() || closed; });
 	}
 
-	MCTS_player black("name=black " + black_args + " role=black");
-	MCTS_player white("name=white " + white_args + " role=white");
+private:
+	std::deque<std::string> lines;
+	std::mutex lock;
+	std::condition_variable ready;
+	bool closed = false;
+};
 
-	if (!shell) { // launch standard local games
-		while (!stats.is_finished()) {
-//			std::cerr << "======== Game " << stats.step() << " ========" << std::endl;
-			black.open_episode("~:" + white.name());
-			white.open_episode(black.name() + ":~");
+/**
+ * a connected socket as an input and an output stream, which closes the socket when destroyed
+ * the two streams have buffers and states of their own, so that one thread may read while another writes,
+ * and the end of the input, e.g., by a client that shuts down its writing, does not stop the replies
+ */
+class socket_stream {
+public:
+	socket_stream(int fd) : fd(fd), reading(fd), writing(fd), in(&reading), out(&writing) {}
+	socket_stream(const socket_stream&) = delete;
+	socket_stream& operator =(const socket_stream&) = delete;
+	~socket_stream() {
+		out.flush();
+		::close(fd);
+	}
+	void shutdown() { ::shutdown(fd, SHUT_RDWR); }
 
-			stats.open_episode(black.name() + ":" + white.name());
-			episode& game = stats.back();
-			while (true) {
-				agent& who = game.take_turns(black, white);
-				action move = who.take_action(game.state());
-//				std::cerr << game.state() << "#" << game.step() << " " << who.name() << ": " << move << std::endl;
-				if (game.apply_action(move) != true) break;
-				if (who.check_for_win(game.state())) break;
+private:
+	struct input_buffer : public std::streambuf {
+		int fd;
+		char buf[4096];
+		input_buffer(int fd) : fd(fd) { setg(buf, buf, buf); }
+		int underflow() {
+			ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+			if (n <= 0) return traits_type::eof();
+			setg(buf, buf, buf + n);
+			return traits_type::to_int_type(*gptr());
+		}
+	};
+	struct output_buffer : public std::streambuf {
+		int fd;
+		char buf[4096];
+		output_buffer(int fd) : fd(fd) { setp(buf, buf + sizeof(buf)); }
+		int overflow(int c) {
+			if (sync() != 0) return traits_type::eof();
+			if (c != traits_type::eof()) sputc(c);
+			return traits_type::not_eof(c);
+		}
+		int sync() {
+			for (char* p = pbase(); p < pptr(); ) {
+				ssize_t n = ::send(fd, p, pptr() - p, MSG_NOSIGNAL);
+				if (n <= 0) return -1;
+				p += n;
 			}
-			agent& win = game.last_turns(black, white);
-			stats.close_episode(win.name());
+			setp(buf, buf + sizeof(buf));
+			return 0;
+		}
+	};
+
+	int fd;
+	input_buffer reading;
+	output_buffer writing;
+
+public:
+	std::istream in;
+	std::ostream out;
+};
 
-			black.close_episode(win.name());
-			white.close_episode(win.name());
+/**
+ * listen at a TCP port as [host:]port, where the host is 127.0.0.1 by default, or at a Unix socket path,
+ * and return the socket, or -1 if it fails
+ */
+int listen_at(const std::string& address) {
+	int fd = -1;
+	if (address.find('/') != std::string::npos) {
+		sockaddr_un addr = {};
+		addr.sun_family = AF_UNIX;
+		std::strncpy(addr.sun_path, address.c_str(), sizeof(addr.sun_path) - 1);
+		unlink(address.c_str());
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd != -1 && bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) close(fd), fd = -1;
+	} else {
+		size_t colon = address.rfind(':');
+		std::string host = colon == std::string::npos ? "127.0.0.1" : address.substr(0, colon);
+		std::string port = colon == std::string::npos ? address : address.substr(colon + 1);
+		addrinfo hints = {}, *res = nullptr;
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = AI_PASSIVE;
+		if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) return -1;
+		for (addrinfo* ai = res; ai && fd == -1; ai = ai->ai_next) {
+			fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+			int on = 1;
+			if (fd != -1) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+			if (fd != -1 && bind(fd, ai->ai_addr, ai->ai_addrlen) != 0) close(fd), fd = -1;
 		}
-	} else { // launch GTP shell
-		for (std::string command; std::getline(std::cin, command); ) {
-			if (command.back() == '\r') command.pop_back();
-			if (command.empty()) continue;
+		freeaddrinfo(res);
+	}
+	if (fd != -1 && listen(fd, 64) != 0) close(fd), fd = -1;
+	return fd;
+}
+
+/**
+ * serve a GTP session, reading the commands from in and writing the replies to out, until quit or the end of in
+ * the game is kept in stats, and played by the given players, where white_player is black_player in self-play
+ */
+void gtp_session(std::shared_ptr<std::istream> in, std::ostream& out, statistics& stats,
+		MCTS_player& black_player, MCTS_player& white_engine, const std::string& name, const std::string& version) {
+	agent& black = black_player;
+	agent& white = white_engine;
+	std::shared_ptr<line_reader> input = line_reader::start(in);
+	for (std::string command; input->next(command); ) {
+		if (command.size() && command.back() == '\r') command.pop_back();
+		if (command.empty()) continue;
 
-			std::vector<std::string> args;
-			std::istringstream iss(command);
-			for (std::string s; getline(iss, s, ' '); args.push_back(s));
+		std::vector<std::string> args;
+		std::istringstream iss(command);
+		for (std::string s; getline(iss, s, ' '); args.push_back(s));
 
-			std::string reply;
+		// a command with too few arguments, or an argument that is not a number where one is expected, fails
+		// without touching the session, since one process serves all of them
+		static const std::map<std::string, size_t> arity = { { "play", 3 }, { "genmove", 2 }, { "boardsize", 2 } };
+		auto needed = arity.find(args[0]);
+		if (needed != arity.end() && args.size() < needed->second) {
+			out << "? " << "syntax error" << std::endl << std::endl;
+			continue;
+		}
+
+		std::string reply;
+		try {
 			if (args[0] == "play" || args[0] == "genmove") { // play a move, or generate a move and play
 				if (!stats.is_episode_ongoing()) { // should open an episode
 					black.open_episode("~:" + white.name());
@@ -112,21 +213,23 @@ int main(int argc, const char* argv[]) {
 
 				episode& game = stats.back();
 				agent& who = game.take_turns(black, white);
-				if (who.role()[0] != std::tolower(args[1][0])) { // player mismatch?!
-					std::cout << "= " << "resign" << std::endl << std::endl;
+				// a player of role=both plays either color, which is the side to move of the state
+				char color = who.role() != "both" ? who.role()[0] : game.state().info().who_take_turns == board::black ? 'b' : 'w';
+				if (color != std::tolower(args[1][0])) { // player mismatch?!
+					out << "= " << "resign" << std::endl << std::endl;
 					// show the error message and terminate the shell
 					std::cerr << "player color " << args[1] << " mismatch!" << std::endl;
 					std::cerr << "current state, "
-					          << who.role() << " to play: " << std::endl << game.state();
+					          << (color == 'b' ? "black" : "white") << " to play: " << std::endl << game.state();
 					break;
 				}
 				if (args[0] == "play") { // play a move
 					std::string types = "?bw"; // black == 1, white == 2
-					action::place move(args[2], types.find(who.role()[0]));
+					action::place move(args[2], types.find(color));
 					if (game.apply_action(move) != true) { // remote plays an illegal move?!
-						std::cout << "= " << "resign" << std::endl << std::endl;
+						out << "= " << "resign" << std::endl << std::endl;
 						// show the error message and terminate the shell
-						std::cerr << who.role() << " plays an illegal action!" << std::endl;
+						std::cerr << (color == 'b' ? "black" : "white") << " plays an illegal action!" << std::endl;
 						const char* reason[] = {
 							"legal",
 							"illegal_turn",
@@ -145,13 +248,65 @@ int main(int argc, const char* argv[]) {
 					}
 				} else if (args[0] == "genmove") { // generate a move and play
 					action::place move = who.take_action(game.state());
-					if (game.apply_action(move) == true) {
+					if (game.apply_action(move, who.root_visits()) == true) {
 						reply = move.position();
 					} else { // I have no legal move to play
 						reply = "resign";
 					}
 				}
 
+			} else if (args[0] == "analyze") { // search the position until the next command, and report every interval
+				// usage: analyze [color] [centiseconds], which prints info lines until any command arrives
+				board state = stats.is_episode_ongoing() ? stats.back().state() : board();
+				bool white_turn = stats.is_episode_ongoing() && stats.back().step() % 2;
+				MCTS_player& who = white_turn ? white_engine : black_player;
+				int interval = 100;
+				bool mismatch = false;
+				for (size_t i = 1; i < args.size(); i++) {
+					if (std::isdigit(args[i][0])) interval = std::max(1, std::stoi(args[i]));
+					else if (std::tolower(args[i][0]) != (white_turn ? 'w' : 'b')) mismatch = true;
+				}
+				if (mismatch) { // a failure reply, which leaves the game as it is
+					out << "? " << "color mismatch" << std::endl << std::endl;
+					continue;
+				} else {
+					out << "= " << std::endl;
+					who.start(state, true);
+					for (bool done = false; !done; ) {
+						done = input->wait_for(std::chrono::milliseconds(interval * 10ll));
+						MCTS_player::analysis a = who.poll();
+						std::ostringstream info;
+						for (size_t i = 0; i < a.root.children.size(); i++) {
+							const search_control::child& c = a.root.children[i];
+							if (c.visit == 0) continue;
+							info << (i ? " " : "") << "info move " << std::string(c.move.position())
+							     << " visits " << c.visit << " winrate " << (10000l * c.win / c.visit) << " order " << i << " pv";
+							for (const action::place& m : c.pv) info << " " << std::string(m.position());
+							if (c.pv.empty()) info << " " << std::string(c.move.position());
+						}
+						if (info.tellp() > 0) out << info.str() << std::endl;
+					}
+					who.stop();
+					out << std::endl;
+					continue;
+				}
+
+			} else if (args[0] == "top_moves") { // search the position with the budget, and list the best k moves
+				// usage: top_moves [k], which replies a line of move, visits, value, its 95% interval and pv for each
+				board state = stats.is_episode_ongoing() ? stats.back().state() : board();
+				bool white_turn = stats.is_episode_ongoing() && stats.back().step() % 2;
+				MCTS_player& who = white_turn ? white_engine : black_player;
+				MCTS_player::analysis a = who.analyze(state, args.size() > 1 ? std::stoi(args[1]) : 0);
+				std::ostringstream list;
+				list.precision(4);
+				list << std::fixed;
+				for (const search_control::child& c : a.root.children) {
+					list << (list.tellp() > 0 ? "\n" : "") << std::string(c.move.position()) << " visits " << c.visit
+					     << " value " << c.value() << " lcb " << c.lower() << " ucb " << c.upper() << " pv";
+					for (const action::place& m : c.pv) list << " " << std::string(m.position());
+				}
+				reply = list.str();
+
 			} else if (args[0] == "clear_board" || args[0] == "quit") { // reset game, or quit
 				if (stats.is_episode_ongoing()) { // should close an opened episode
 					agent& win = stats.back().last_turns(black, white);
@@ -182,13 +337,324 @@ int main(int argc, const char* argv[]) {
 				reply = "2";
 			} else if (args[0] == "list_commands") { // print supported commands
 				reply = "play\n" "genmove\n" "clear_board\n" "showboard\n" "boardsize\n"
-				        "name\n" "version\n" "protocol_version\n" "list_commands\n" "quit\n";
+				        "name\n" "version\n" "protocol_version\n" "list_commands\n" "analyze\n" "top_moves\n" "quit\n";
 			} else {
 				reply = "unknown command";
 			}
+		} catch (const std::logic_error&) { // std::invalid_argument or std::out_of_range of std::stoi
+			out << "? " << "syntax error" << std::endl << std::endl;
+			continue;
+		}
 
-			std::cout << "= " << reply << std::endl << std::endl;
+		out << "= " << reply << std::endl << std::endl;
+	}
+}
+
+int main(int argc, const char* argv[]) {
+	std::cout << "HollowNoGo-Demo: ";
+	std::copy(argv, argv + argc, std::ostream_iterator<const char*>(std::cout, " "));
+	std::cout << std::endl << std::endl;
+
+	size_t total = 1000, block = 0, limit = 0;
+	std::string black_args, white_args;
+	std::string load_path, save_path;
+	std::string region_path;
+	int region_size = 10;
+	std::string name = "TCG-HollowNoGo-Demo", version = "2022"; // for GTP shell
+	bool shell = false;
+	bool self_play = false;
+	int parallel = 1;
+	std::string analyze_path;
+	int budget = 0;
+	std::string listen_address;
+	int pool = 0;
+	std::string export_path;
+	std::string train_args;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		auto match_arg = [&](std::string flag) -> bool {
+			auto it = arg.find_first_not_of('-');
+			return arg.find(flag, it) == it;
+		};
+		auto next_opt = [&]() -> std::string {
+			auto it = arg.find('=') + 1;
+			return it ? arg.substr(it) : argv[++i];
+		};
+		if (match_arg("total")) {
+			total = std::stoull(next_opt());
+		} else if (match_arg("block")) {
+			block = std::stoull(next_opt());
+		} else if (match_arg("limit")) {
+			limit = std::stoull(next_opt());
+		} else if (match_arg("black")) {
+			black_args = next_opt();
+		} else if (match_arg("white")) {
+			white_args = next_opt();
+		} else if (match_arg("load")) {
+			load_path = next_opt();
+		} else if (match_arg("save")) {
+			save_path = next_opt();
+		} else if (match_arg("name")) {
+			name = next_opt();
+		} else if (match_arg("version")) {
+			version = next_opt();
+		} else if (match_arg("shell")) {
+			shell = true;
+		} else if (match_arg("self-play")) {
+			self_play = true;
+		} else if (match_arg("parallel")) {
+			parallel = std::stoi(next_opt());
+		} else if (match_arg("build-regions")) {
+			region_path = next_opt();
+		} else if (match_arg("region-size")) {
+			region_size = std::stoi(next_opt());
+		} else if (match_arg("analyze")) {
+			analyze_path = next_opt();
+		} else if (match_arg("budget")) {
+			budget = std::stoi(next_opt());
+		} else if (match_arg("listen")) {
+			listen_address = next_opt();
+		} else if (match_arg("pool")) {
+			pool = std::stoi(next_opt());
+		} else if (match_arg("export")) {
+			export_path = next_opt();
+		} else if (match_arg("train")) {
+			train_args = next_opt();
+		}
+	}
+
+	if (region_path.size()) { // solve the small regions along random games, and save them as a table
+		if (region_size < 1 || region_size > region_table::max_region) {
+			std::cerr << "invalid region size " << region_size << ", which should be 1 to " << region_table::max_region << std::endl;
+			return 1;
+		}
+		region_solver solver;
+		std::default_random_engine engine;
+		for (size_t i = 0; i < total; i++) solver.explore(bitboard(board()), region_size, engine);
+		solver.save(region_path, region_size);
+		std::cout << "regions = " << solver.size() << std::endl;
+		return 0;
+	}
+
+	if (export_path.size()) { // pack the episodes of --load into a dataset for training, see dataset
+		std::ifstream in(load_path, std::ios::in);
+		long records = dataset::build(in, export_path);
+		if (records < 0) {
+			std::cerr << "cannot write dataset " << export_path << std::endl;
+			return 1;
+		}
+		std::cout << "records = " << records << std::endl;
+		return 0;
+	}
+
+	if (train_args.size()) { // train the network on a dataset, see trainer
+		return trainer(train_args).run(std::cout) ? 0 : 1;
+	}
+
+	statistics stats(total, block, limit);
+
+	if (load_path.size()) {
+		std::ifstream in(load_path, std::ios::in);
+		in >> stats;
+		in.close();
+		if (stats.is_finished()) stats.summary();
+	}
+
+	// the arguments of the players, where extra goes first so that the given arguments may override it
+	auto black_spec = [&](const std::string& extra) {
+		return self_play ? "name=self " + extra + black_args + " role=both reuse=1" : "name=black " + extra + black_args + " role=black";
+	};
+	auto white_spec = [&](const std::string& extra) {
+		return "name=white " + extra + white_args + " role=white";
+	};
+	// play a game until the player to move has no legal move, and return the winner
+	auto play = [](agent& black, agent& white, episode& game) -> agent& {
+		black.open_episode("~:" + white.name());
+		white.open_episode(black.name() + ":~");
+		while (true) {
+			agent& who = game.take_turns(black, white);
+			action move = who.take_action(game.state());
+//			std::cerr << game.state() << "#" << game.step() << " " << who.name() << ": " << move << std::endl;
+			if (game.apply_action(move, who.root_visits()) != true) break;
+			if (who.check_for_win(game.state())) break;
+		}
+		agent& win = game.last_turns(black, white);
+		black.close_episode(win.name());
+		white.close_episode(win.name());
+		return win;
+	};
+
+	if (analyze_path.size()) { // analyze every position of the file with the black player, and print them in order
+		// the file holds episode records as saved by --save, whose positions before every move are analyzed,
+		// and board dumps as printed by showboard, where the side to move follows from the number of stones
+		std::vector<std::pair<std::string, board> > positions;
+		int records = 0;
+		std::ifstream in(analyze_path, std::ios::in);
+		for (char c; in >> c; ) {
+			in.unget();
+			if (c == '(') { // an episode record
+				std::string line;
+				std::getline(in, line);
+				episode game;
+				std::stringstream(line) >> game;
+				board state;
+				int index = 0;
+				for (const action& move : game.actions()) {
+					positions.emplace_back("record=" + std::to_string(records) + " move=" + std::to_string(index++), state);
+					if (move.apply(state) != board::legal) break;
+				}
+				records++;
+			} else { // a board dump
+				board state;
+				if (!(in >> state)) break;
+				int stones = 0;
+				for (int i = 0; i < board::size_x * board::size_y; i++) stones += (state(i) == board::black) - (state(i) == board::white);
+				state.info({ stones > 0 ? board::white : board::black });
+				positions.emplace_back("board", state);
+			}
+		}
+
+		// the workers take the positions in order, each with its own player and share of the cores,
+		// and the results are printed as soon as all results before them are done
+		std::vector<std::string> results(positions.size());
+		std::vector<bool> finished(positions.size());
+		size_t next = 0;
+		std::mutex lock;
+		std::condition_variable ready;
+		std::vector<std::vector<int> > cores = cpu_topology().partition(std::max(parallel, 1));
+		std::vector<std::thread> workers;
+		for (int w = 0; w < std::max(parallel, 1); w++) {
+			std::string extra = cores[w].size() ? "cpus=" + cpu_topology::format(cores[w]) + " " : "";
+			workers.emplace_back([&, extra]() {
+				MCTS_player analyzer("name=analyze " + extra + black_args + " role=both" +
+					(budget ? " simulation=" + std::to_string(budget) : ""));
+				while (true) {
+					size_t i;
+					{
+						std::lock_guard<std::mutex> guard(lock);
+						if (next == positions.size()) break;
+						i = next++;
+					}
+					const board& state = positions[i].second;
+					MCTS_player::analysis a = analyzer.analyze(state);
+					std::ostringstream line;
+					line.precision(4);
+					line << std::fixed;
+					line << i << " " << positions[i].first << " to_play=" << (state.info().who_take_turns == board::white ? "W" : "B") << ":";
+					for (const search_control::child& c : a.root.children) {
+						line << (&c == &a.root.children[0] ? " " : " | ") << std::string(c.move.position()) << " visits " << c.visit
+						     << " value " << c.value() << " lcb " << c.lower() << " ucb " << c.upper() << " pv";
+						for (const action::place& m : c.pv) line << " " << std::string(m.position());
+					}
+					if (a.root.children.empty()) line << " " << (action(a.best).type() == action::place::type ? std::string(a.best.position()) : "resign");
+					std::lock_guard<std::mutex> guard(lock);
+					results[i] = line.str();
+					finished[i] = true;
+					ready.notify_all();
+				}
+			});
+		}
+		for (size_t i = 0; i < positions.size(); i++) {
+			std::unique_lock<std::mutex> guard(lock);
+			ready.wait(guard, [&]() { return finished[i]; });
+			std::cout << results[i] << std::endl;
+			results[i].clear();
+		}
+		for (std::thread& worker : workers) worker.join();
+		return 0;
+	}
+
+	if (!shell && parallel > 1) { // launch concurrent local games, each with its own players and share of the cores
+		std::vector<std::vector<int> > cores = cpu_topology().partition(parallel);
+		size_t remaining = stats.is_finished() ? 0 : total - stats.step();
+		std::mutex lock;
+		std::vector<std::thread> workers;
+		for (int w = 0; w < parallel; w++) {
+			std::string extra = cores[w].size() ? "cpus=" + cpu_topology::format(cores[w]) + " " : "";
+			workers.emplace_back([&, extra]() {
+				MCTS_player black_player(black_spec(extra));
+				MCTS_player white_player(white_spec(extra));
+				agent& black = black_player;
+				agent& white = self_play ? black_player : white_player;
+				while (true) {
+					{
+						std::lock_guard<std::mutex> guard(lock);
+						if (remaining == 0) break;
+						remaining--;
+					}
+					episode game;
+					game.open_episode(black.name() + ":" + white.name());
+					agent& win = play(black, white, game);
+					std::lock_guard<std::mutex> guard(lock);
+					stats.open_episode(black.name() + ":" + white.name());
+					stats.back() = game;
+					stats.close_episode(win.name());
+				}
+			});
+		}
+		for (std::thread& worker : workers) worker.join();
+	}
+
+	if (listen_address.size()) { // serve GTP sessions over sockets, each with its own game and players
+		// the searches of all sessions share --pool threads, one for every usable CPU by default
+		int server = listen_at(listen_address);
+		if (server == -1) {
+			std::cerr << "cannot listen at " << listen_address << std::endl;
+			return 1;
+		}
+		search_scheduler::global().configure(pool ? pool : std::max<int>(1, cpu_topology().cpus().size()));
+		std::signal(SIGPIPE, SIG_IGN);
+		// the sessions take copies of the options, and are joined before returning, the finished ones after every accept
+		// the k-th session is given session=k, so that the sessions pinned by pin= start on different CPUs
+		std::mutex lock;
+		std::list<std::pair<std::thread, std::shared_ptr<std::atomic<bool> > > > sessions;
+		for (int fd, k = 0; (fd = accept(server, nullptr, nullptr)) != -1 || errno == EINTR; ) {
+			if (fd == -1) continue;
+			const std::string offset = "session=" + std::to_string(k++) + " ";
+			const std::string black_session = black_spec(offset), white_session = white_spec(offset);
+			std::shared_ptr<std::atomic<bool> > finished = std::make_shared<std::atomic<bool> >(false);
+			sessions.emplace_back(std::thread([=, &lock]() {
+				std::shared_ptr<socket_stream> io = std::make_shared<socket_stream>(fd);
+				statistics session(total, block, limit);
+				MCTS_player black_player(black_session);
+				MCTS_player white_player(white_session);
+				gtp_session(std::shared_ptr<std::istream>(io, &io->in), io->out, session, black_player, self_play ? black_player : white_player, name, version);
+				io->out.flush();
+				io->shutdown();
+				if (save_path.size() && session.step()) { // append the games of the session
+					std::lock_guard<std::mutex> guard(lock);
+					std::ofstream out(save_path, std::ios::out | std::ios::app);
+					out << session;
+				}
+				*finished = true;
+			}), finished);
+			for (auto it = sessions.begin(); it != sessions.end(); ) {
+				if (!*it->second) { ++it; continue; }
+				it->first.join();
+				it = sessions.erase(it);
+			}
 		}
+		close(server);
+		for (auto& session : sessions) session.first.join();
+		return 0;
+	}
+
+	MCTS_player black_player(black_spec(""));
+	MCTS_player white_player(white_spec(""));
+	agent& black = black_player;
+	agent& white = self_play ? black_player : white_player; // in self-play, one engine serves both sides
+	MCTS_player& white_engine = self_play ? black_player : white_player;
+
+	if (!shell) { // launch standard local games
+		while (!stats.is_finished()) {
+//			std::cerr << "======== Game " << stats.step() << " ========" << std::endl;
+			stats.open_episode(black.name() + ":" + white.name());
+			agent& win = play(black, white, stats.back());
+			stats.close_episode(win.name());
+		}
+	} else { // launch GTP shell
+		gtp_session(std::shared_ptr<std::istream>(&std::cin, [](std::istream*) {}), std::cout, stats,
+			black_player, white_engine, name, version);
 	}
 
 	if (save_path.size()) {
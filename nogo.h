@@ -0,0 +1,96 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * nogo.h: C interface of the engine, built as libnogo.so and libnogo.a by make lib
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#ifndef NOGO_H
+#define NOGO_H
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * the version of this interface, which changes only when a declaration below changes
+ */
+#define NOGO_API_VERSION 1
+
+/**
+ * the library is built with hidden symbols, so that only the functions below are exported
+ */
+#ifdef NOGO_EXPORT
+#define NOGO_API __attribute__((visibility("default")))
+#else
+#define NOGO_API
+#endif
+
+/**
+ * an engine is a player with its own position and search trees; the functions of one engine must not be called
+ * from two threads at once, while different engines may be used from different threads
+ *
+ * a cell is the index x * 9 + y of the board, where A1 is 0, A2 is 1, and B1 is 9, as in board::point
+ */
+typedef struct nogo_engine nogo_engine;
+
+/**
+ * the statistics of a move at the root after a search, from the view of the side to move
+ */
+typedef struct nogo_move_stat {
+	int cell;
+	int visits;
+	int wins;
+	double lower, upper; /* the 95% Wilson bounds of wins / visits */
+} nogo_move_stat;
+
+NOGO_API int nogo_api_version(void);
+
+/**
+ * create an engine with the player arguments of nogo --black, such as "search=p-mcts simulation=1000 thread=4",
+ * or return NULL if they cannot be parsed
+ */
+NOGO_API nogo_engine* nogo_engine_create(const char* args);
+NOGO_API void nogo_engine_free(nogo_engine* engine);
+
+/**
+ * set the position to the empty board followed by the given moves, black first, and return 0, or return
+ * the 1-based index of the first illegal move and keep the position before it
+ * the moves are read in place and not kept
+ */
+NOGO_API int nogo_engine_set_position(nogo_engine* engine, const int* cells, size_t count);
+
+/**
+ * play one more move on the position, and return 0, or -1 if it is illegal
+ */
+NOGO_API int nogo_engine_play(nogo_engine* engine, int cell);
+
+/**
+ * the side to move, 1 for black and 2 for white
+ */
+NOGO_API int nogo_engine_to_move(const nogo_engine* engine);
+
+/**
+ * search the position with the given simulations, or with simulation= if 0, and return the best cell,
+ * or -1 if the side to move has no legal move; the position is not changed
+ */
+NOGO_API int nogo_engine_search(nogo_engine* engine, int simulations);
+
+/**
+ * copy the root moves of the last search, by visits, into stats, and return how many there are in total
+ */
+NOGO_API size_t nogo_engine_stats(const nogo_engine* engine, nogo_move_stat* stats, size_t capacity);
+
+/**
+ * copy the principal variation of the best move of the last search into cells, and return its length in total
+ */
+NOGO_API size_t nogo_engine_pv(const nogo_engine* engine, int* cells, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,214 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * pool.h: Huge-page-backed, thread-local memory pools for the search nodes
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <iostream>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/**
+ * a pool of fixed-size blocks, carved from 2 MiB chunks that are aligned to their size
+ *
+ * every thread allocates from its own pool, see local(), so that allocation never synchronizes and the
+ * nodes that a thread expands lie together in its chunks; each chunk is bound to the NUMA node of the
+ * thread that maps it, and is backed by huge pages according to mode()
+ * a block may be freed by any thread: it goes back to the pool that owns its chunk through a lock-free
+ * list, which the owner takes over as a whole once its own free list runs dry
+ * the pools are never destroyed, since their blocks may outlive the threads that allocate them; instead, the pool
+ * of a thread that exits is adopted, with its chunks and free lists, by the next thread that needs a pool of its
+ * size, so that short-lived threads such as those of a session or an analysis do not leave chunks behind
+ * the pools are off unless huge_pages= is given, and the mode is process-wide and fixed by the first huge_pages=
+ * or the first node allocated, so that a node is always freed the way it was allocated; a later huge_pages=
+ * of another mode is ignored with a warning
+ */
+class node_pool {
+public:
+	enum page_mode { off = 0, transparent_pages = 1, explicit_pages = 2, fixed = 4 };
+	enum { chunk_size = 2 << 20 };
+
+	/**
+	 * the page mode by huge_pages=off|auto|explicit, where off leaves the nodes to the global allocator,
+	 * auto maps the chunks with transparent huge pages, and explicit maps them from the reserved huge pages
+	 * and falls back to auto if there is none left
+	 * the word holds the mode and the flag fixed, which is set by the first huge_pages= or the first node allocated
+	 */
+	static std::atomic<int>& mode() {
+		static std::atomic<int> pages(off);
+		return pages;
+	}
+	static bool configure(const std::string& pages) {
+		int want = pages == "explicit" ? explicit_pages : pages == "auto" ? transparent_pages : off;
+		int m = mode().load();
+		while (!(m & fixed))
+			if (mode().compare_exchange_weak(m, want | fixed)) return true;
+		if ((m & ~fixed) == want) return true;
+		std::cerr << "huge_pages=" << pages << " is ignored, since the node pools are already fixed to another mode" << std::endl;
+		return false;
+	}
+
+	/**
+	 * whether the nodes are allocated from the pools, which fixes the mode for the rest of the process
+	 */
+	static bool enabled() {
+		int m = mode().load(std::memory_order_relaxed);
+		if (!(m & fixed)) m = mode().fetch_or(fixed);
+		return (m & ~fixed) != off;
+	}
+
+	/**
+	 * the total size of the chunks mapped by all pools, in bytes
+	 */
+	static std::atomic<size_t>& reserved() {
+		static std::atomic<size_t> bytes(0);
+		return bytes;
+	}
+
+	/**
+	 * the pool of the calling thread for blocks of the given size, one pool for each size and thread
+	 */
+	template<size_t size>
+	static node_pool& local() {
+		static thread_local holder own(size);
+		return *own.pool;
+	}
+
+	void* allocate() {
+		if (!free_list) free_list = remote.exchange(nullptr, std::memory_order_acquire);
+		if (!free_list) refill();
+		block* b = free_list;
+		free_list = b->next;
+		return b;
+	}
+
+	/**
+	 * allocate in ascending address order from chunks of their own, for laying out blocks that are used together,
+	 * see compact_tree; the blocks are freed as any other
+	 */
+	void* allocate_contiguous() {
+		if (bump == bump_end) {
+			bump = static_cast<char*>(map_chunk());
+			reinterpret_cast<chunk*>(bump)->owner = this;
+			bump_end = bump + sizeof(chunk) + (chunk_size - sizeof(chunk)) / size * size;
+			bump += sizeof(chunk);
+			reserved() += chunk_size;
+		}
+		void* p = bump;
+		bump += size;
+		return p;
+	}
+
+	static void release(void* p) {
+		chunk* c = reinterpret_cast<chunk*>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(chunk_size - 1));
+		node_pool* owner = c->owner;
+		block* b = static_cast<block*>(p);
+		b->next = owner->remote.load(std::memory_order_relaxed);
+		while (!owner->remote.compare_exchange_weak(b->next, b, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+private:
+	struct block { block* next; };
+	struct alignas(64) chunk { node_pool* owner; };
+
+	/**
+	 * the pool of a thread, which is taken from the orphaned pools if there is one of the size, and is orphaned
+	 * when the thread exits
+	 */
+	struct holder {
+		node_pool* pool;
+		holder(size_t size) : pool(adopt(size)) {}
+		~holder() {
+			std::lock_guard<std::mutex> guard(registry());
+			orphans().push_back(pool);
+		}
+	};
+	static node_pool* adopt(size_t size) {
+		std::lock_guard<std::mutex> guard(registry());
+		std::vector<node_pool*>& list = orphans();
+		for (size_t i = 0; i < list.size(); i++) {
+			if (list[i]->size != rounded(size)) continue;
+			node_pool* pool = list[i];
+			list.erase(list.begin() + i);
+			return pool;
+		}
+		return new node_pool(size);
+	}
+	static std::vector<node_pool*>& orphans() {
+		static std::vector<node_pool*>* list = new std::vector<node_pool*>; // never destroyed, as threads may outlive it
+		return *list;
+	}
+	static std::mutex& registry() {
+		static std::mutex* lock = new std::mutex;
+		return *lock;
+	}
+
+	static size_t rounded(size_t size) { return (size + 15) & ~size_t(15); }
+
+	node_pool(size_t size) : size(rounded(size)), free_list(nullptr), remote(nullptr), bump(nullptr), bump_end(nullptr) {}
+
+	/**
+	 * map a new chunk and thread its blocks onto the free list
+	 */
+	void refill() {
+		char* base = static_cast<char*>(map_chunk());
+		reinterpret_cast<chunk*>(base)->owner = this;
+		for (size_t k = (chunk_size - sizeof(chunk)) / size; k-- > 0; ) {
+			block* b = reinterpret_cast<block*>(base + sizeof(chunk) + k * size);
+			b->next = free_list;
+			free_list = b;
+		}
+		reserved() += chunk_size;
+	}
+
+	static void* map_chunk() {
+		void* p = MAP_FAILED;
+		if ((mode() & ~fixed) == explicit_pages) {
+			p = mmap(nullptr, chunk_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		}
+		if (p == MAP_FAILED) { // map twice the size, then trim to an aligned chunk
+			char* raw = static_cast<char*>(mmap(nullptr, 2 * chunk_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+			if (raw == MAP_FAILED) throw std::bad_alloc();
+			char* aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(raw) + chunk_size - 1) & ~uintptr_t(chunk_size - 1));
+			if (aligned != raw) munmap(raw, aligned - raw);
+			munmap(aligned + chunk_size, raw + chunk_size - aligned);
+			p = aligned;
+#ifdef MADV_HUGEPAGE
+			madvise(p, chunk_size, MADV_HUGEPAGE);
+#endif
+		}
+		bind_local(p);
+		return p;
+	}
+
+	/**
+	 * prefer the NUMA node of the calling thread for the chunk, ignored if the kernel has no NUMA support
+	 */
+	static void bind_local(void* p) {
+#if defined(SYS_getcpu) && defined(SYS_mbind)
+		unsigned cpu = 0, numa = 0;
+		if (syscall(SYS_getcpu, &cpu, &numa, nullptr) != 0 || numa >= 64) return;
+		unsigned long mask = 1ul << numa;
+		const int preferred = 1; // MPOL_PREFERRED
+		syscall(SYS_mbind, p, size_t(chunk_size), preferred, &mask, 64ul, 0u);
+#endif
+	}
+
+	size_t size;
+	block* free_list;
+	std::atomic<block*> remote;
+	char* bump;
+	char* bump_end;
+};
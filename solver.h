@@ -0,0 +1,605 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * solver.h: Exact endgame solver by independent regions and combinatorial game sums
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "board.h"
+#include "action.h"
+#include "bitboard.h"
+
+/**
+ * read-only table of solved region values, memory-mapped from a file made by region_solver::save
+ *
+ * the file holds a header, the records sorted by region signature, the canonical graphs of the regions,
+ * a bucket index over the top 16 bits of the signatures, and the canonical forms of all values in
+ * post-order (options before the forms that refer to them), so that a lookup is a short binary search
+ * within one bucket, which compares the graph of each record of the signature, so that two regions
+ * whose signatures collide never share a value
+ */
+class region_table {
+public:
+	struct header {
+		char magic[8];
+		uint32_t max_size, games;
+		uint64_t options, records, graphs;
+	};
+	struct record {
+		uint64_t key;
+		uint32_t game, graph; // the offset of the graph in words
+	};
+	typedef std::vector<uint64_t> graph_type; // see region_solver::signature
+	enum { max_region = 32 }; // the most cells of a region with a signature
+	struct entry {
+		uint32_t offset;
+		uint16_t left, right;
+	};
+	enum { buckets = 1 << 16 };
+
+	region_table(const std::string& path) : base(nullptr), length(0) {
+		int fd = open(path.c_str(), O_RDONLY);
+		struct stat st;
+		if (fd == -1 || fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(header)) {
+			std::cerr << "cannot open region table " << path << std::endl;
+			if (fd != -1) close(fd);
+			return;
+		}
+		void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (map == MAP_FAILED) return;
+		base = static_cast<const char*>(map);
+		length = st.st_size;
+		if (std::memcmp(head().magic, magic(), 8) != 0 || head().max_size > max_region || length != layout_size(head())) {
+			std::cerr << "invalid region table " << path << std::endl;
+			munmap(const_cast<char*>(base), length);
+			base = nullptr;
+		}
+	}
+	~region_table() {
+		if (base) munmap(const_cast<char*>(base), length);
+	}
+
+	/**
+	 * the table of a file, mapped once for all the players of the process as long as any of them uses it
+	 */
+	static std::shared_ptr<region_table> shared(const std::string& path) {
+		static std::mutex lock;
+		static std::map<std::string, std::weak_ptr<region_table> > tables;
+		std::lock_guard<std::mutex> guard(lock);
+		std::shared_ptr<region_table> table = tables[path].lock();
+		if (!table) tables[path] = table = std::make_shared<region_table>(path);
+		return table;
+	}
+
+public:
+	bool is_open() const { return base; }
+	int max_size() const { return base ? head().max_size : 0; }
+	size_t size() const { return base ? head().records : 0; }
+	size_t forms() const { return base ? head().games : 0; }
+
+	/**
+	 * return the game id in this table of the region with the given signature and graph, or -1 if absent
+	 */
+	int find(uint64_t key, const graph_type& form) const {
+		if (!base) return -1;
+		const uint32_t* index = bucket();
+		const record* first = records() + index[key >> 48];
+		const record* last = records() + index[(key >> 48) + 1];
+		const record* it = std::lower_bound(first, last, key,
+			[](const record& r, uint64_t k) { return r.key < k; });
+		for (; it != last && it->key == key; it++) {
+			if (it->graph + form.size() > head().graphs) continue;
+			if (std::equal(form.begin(), form.end(), graphs() + it->graph)) return int(it->game);
+		}
+		return -1;
+	}
+
+	const entry& game(int id) const { return games()[id]; }
+	const uint32_t* options(int id) const { return option() + games()[id].offset; }
+
+	/**
+	 * the total size of a file with the counts given in its header
+	 */
+	static size_t layout_size(const header& h) {
+		return sizeof(header) + h.records * sizeof(record) + h.graphs * sizeof(uint64_t) + (buckets + 1) * sizeof(uint32_t)
+		     + h.games * sizeof(entry) + h.options * sizeof(uint32_t);
+	}
+	static const char* magic() { return "NOGOREG2"; }
+
+private:
+	const header& head() const { return *reinterpret_cast<const header*>(base); }
+	const record* records() const { return reinterpret_cast<const record*>(base + sizeof(header)); }
+	const uint64_t* graphs() const { return reinterpret_cast<const uint64_t*>(records() + head().records); }
+	const uint32_t* bucket() const { return reinterpret_cast<const uint32_t*>(graphs() + head().graphs); }
+	const entry* games() const { return reinterpret_cast<const entry*>(bucket() + buckets + 1); }
+	const uint32_t* option() const { return reinterpret_cast<const uint32_t*>(games() + head().games); }
+
+	const char* base;
+	size_t length;
+};
+
+/**
+ * NoGo is a normal play game: the player who cannot move loses
+ * once the board splits into independent regions (see bitboard::regions), the whole position
+ * is the disjunctive sum of the regions, and its winner follows from the sum of their values
+ *
+ * the values are kept in canonical form (dominated options removed, reversible options bypassed),
+ * hash-consed in a table so that equal values share the same id
+ * black is Left and white is Right, i.e., a positive value is a win for black
+ */
+class region_solver {
+public:
+	typedef int game;
+
+	region_solver() { zero = make({}, {}); }
+
+public:
+	/**
+	 * find a winning move for the side to move of b
+	 * return action() if the side to move loses against perfect play, or if any region
+	 * has more than max_region cells that are playable by either side
+	 */
+	action solve(const bitboard& b, int max_region) {
+		board::piece_type who = b.take_turns();
+		bitboard::bits legal_black, legal_white;
+		b.legal_moves(legal_black, legal_white);
+		std::vector<bitboard::bits> parts = b.regions();
+		for (bitboard::bits part : parts) {
+			if (bitboard::count(part & (legal_black | legal_white)) > max_region) return action();
+		}
+		std::vector<game> values;
+		for (bitboard::bits part : parts) values.push_back(stored_value(b, part));
+		bitboard::bits legal = (who == board::black ? legal_black : legal_white);
+		for (size_t r = 0; r < parts.size(); r++) {
+			game rest = zero;
+			for (size_t i = 0; i < values.size(); i++) if (i != r) rest = add(rest, values[i]);
+			for (bitboard::bits moves = legal & parts[r]; moves; moves &= moves - 1) {
+				int i = bitboard::lowest(moves);
+				bitboard after = b;
+				after.place(i, who);
+				game total = add(rest, value_of_parts(after, parts[r] & ~bitboard::bit(i)));
+				// the opponent moves next and must lose
+				if (who == board::black ? le(zero, total) : le(total, zero))
+					return action::place(i, who);
+			}
+		}
+		return action();
+	}
+
+	/**
+	 * whether the side to move of b wins against perfect play
+	 */
+	bool wins(const bitboard& b) {
+		game total = zero;
+		for (bitboard::bits part : b.regions()) total = add(total, stored_value(b, part));
+		return b.take_turns() == board::black ? !le(total, zero) : !le(zero, total);
+	}
+
+	/**
+	 * the value of the region of b, looked up in the region table first if there is one
+	 *
+	 * the table holds regions that occur in games, so only the regions of the actual position
+	 * are looked up, while the positions reached inside the search are left to the memo
+	 */
+	game stored_value(const bitboard& b, bitboard::bits region) {
+		if (table && bitboard::count(region) <= table->max_size()) {
+			bitboard::bits around = bitboard::neighbors(region);
+			bitboard::bits black = bitboard::block(around & b.stones(board::black), b.stones(board::black));
+			bitboard::bits white = bitboard::block(around & b.stones(board::white), b.stones(board::white));
+			region_key key = { region, black, white };
+			auto it = memo.find(key);
+			if (it != memo.end()) return it->second;
+			bool swapped;
+			region_table::graph_type form;
+			uint64_t sig = signature(region, black, white, &swapped, &form);
+			int id = table->find(sig, form);
+			if (id != -1) return memo[key] = swapped ? negate(translate(id)) : translate(id);
+		}
+		return value(b, region);
+	}
+
+	/**
+	 * the value of the region of b, which should be one of b.regions()
+	 */
+	game value(const bitboard& b, bitboard::bits region) {
+		bitboard::bits around = bitboard::neighbors(region);
+		bitboard::bits black = bitboard::block(around & b.stones(board::black), b.stones(board::black));
+		bitboard::bits white = bitboard::block(around & b.stones(board::white), b.stones(board::white));
+		region_key key = { region, black, white };
+		auto it = memo.find(key);
+		if (it != memo.end()) return it->second;
+
+		bitboard::bits legal_black, legal_white;
+		b.legal_moves(legal_black, legal_white);
+		std::vector<game> left, right;
+		for (bitboard::bits moves = legal_black & region; moves; moves &= moves - 1) {
+			bitboard after = b;
+			after.place(bitboard::lowest(moves), board::black);
+			left.push_back(value_of_parts(after, region & ~bitboard::bit(bitboard::lowest(moves))));
+		}
+		for (bitboard::bits moves = legal_white & region; moves; moves &= moves - 1) {
+			bitboard after = b;
+			after.place(bitboard::lowest(moves), board::white);
+			right.push_back(value_of_parts(after, region & ~bitboard::bit(bitboard::lowest(moves))));
+		}
+		game g = make(left, right);
+		memo[key] = g;
+		return g;
+	}
+
+	/**
+	 * the sum of two values
+	 */
+	game add(game g, game h) {
+		if (g == zero) return h;
+		if (h == zero) return g;
+		if (g > h) std::swap(g, h);
+		uint64_t key = (uint64_t(g) << 32) | uint64_t(h);
+		auto it = sums.find(key);
+		if (it != sums.end()) return it->second;
+		std::vector<game> left, right;
+		for (size_t i = 0; i < forms[g].left.size(); i++) left.push_back(add(forms[g].left[i], h));
+		for (size_t i = 0; i < forms[h].left.size(); i++) left.push_back(add(g, forms[h].left[i]));
+		for (size_t i = 0; i < forms[g].right.size(); i++) right.push_back(add(forms[g].right[i], h));
+		for (size_t i = 0; i < forms[h].right.size(); i++) right.push_back(add(g, forms[h].right[i]));
+		game s = make(left, right);
+		sums[key] = s;
+		return s;
+	}
+
+	/**
+	 * whether g <= h, i.e., no left option of g is >= h and no right option of h is <= g
+	 */
+	bool le(game g, game h) {
+		if (g == h) return true;
+		uint64_t key = (uint64_t(g) << 32) | uint64_t(h);
+		auto it = order.find(key);
+		if (it != order.end()) return it->second;
+		bool res = true;
+		for (size_t i = 0; res && i < forms[g].left.size(); i++) res = !le(h, forms[g].left[i]);
+		for (size_t i = 0; res && i < forms[h].right.size(); i++) res = !le(forms[h].right[i], g);
+		order[key] = res;
+		return res;
+	}
+
+	/**
+	 * the canonical form of { left | right }, where all options are canonical
+	 */
+	game make(std::vector<game> left, std::vector<game> right) {
+		for (bool changed = true; changed; ) {
+			changed = false;
+			prune(left, true);
+			prune(right, false);
+			game g = intern(left, right);
+			// bypass reversible options: a left option is reversible through its right option
+			// that is <= g, and is replaced by the left options of that right option
+			for (size_t i = 0; !changed && i < left.size(); i++) {
+				std::vector<game> reverse = forms[left[i]].right;
+				for (game r : reverse) {
+					if (!le(r, g)) continue;
+					std::vector<game> replace = forms[r].left;
+					left.erase(left.begin() + i);
+					left.insert(left.end(), replace.begin(), replace.end());
+					changed = true;
+					break;
+				}
+			}
+			for (size_t i = 0; !changed && i < right.size(); i++) {
+				std::vector<game> reverse = forms[right[i]].left;
+				for (game l : reverse) {
+					if (!le(g, l)) continue;
+					std::vector<game> replace = forms[l].right;
+					right.erase(right.begin() + i);
+					right.insert(right.end(), replace.begin(), replace.end());
+					changed = true;
+					break;
+				}
+			}
+		}
+		return intern(left, right);
+	}
+
+	/**
+	 * drop all the solved values if the tables have grown beyond the limit of entries
+	 */
+	void trim(size_t limit) {
+		if (memo.size() + order.size() < limit) return;
+		std::shared_ptr<region_table> keep = table;
+		*this = region_solver();
+		table = keep;
+		loaded.assign(table ? table->forms() : 0, -1);
+	}
+
+	/**
+	 * use a precomputed table of region values, see save
+	 */
+	bool load(const std::string& path) {
+		table = region_table::shared(path);
+		if (!table->is_open()) table.reset();
+		loaded.assign(table ? table->forms() : 0, -1);
+		return table != nullptr;
+	}
+
+	/**
+	 * solve every region of at most max_size empty cells along a random game from b,
+	 * so that they and all their follow-ups end up in the memo
+	 */
+	template<typename random>
+	void explore(bitboard b, int max_size, random& engine) {
+		for (bitboard::bits moves; (moves = b.legal_moves(b.take_turns())); ) {
+			for (bitboard::bits part : b.regions())
+				if (bitboard::count(part) <= max_size) value(b, part);
+			std::uniform_int_distribution<int> uniform(0, bitboard::count(moves) - 1);
+			b.place(bitboard::select(moves, uniform(engine)), b.take_turns());
+		}
+	}
+
+	/**
+	 * write the values of all solved regions of at most max_size empty cells as a region table
+	 */
+	bool save(const std::string& path, int max_size) {
+		std::map<region_table::graph_type, game> found;
+		for (auto& it : memo) {
+			if (bitboard::count(it.first.region) > max_size) continue;
+			bool swapped;
+			region_table::graph_type form;
+			signature(it.first.region, it.first.black, it.first.white, &swapped, &form);
+			found[form] = swapped ? negate(it.second) : it.second;
+		}
+		std::vector<int> id(forms.size(), -1);
+		std::vector<region_table::entry> entries;
+		std::vector<uint32_t> options;
+		std::vector<region_table::record> records;
+		std::vector<uint64_t> graphs;
+		for (auto& it : found) {
+			number(it.second, id, entries, options);
+			records.push_back({ hash(it.first), uint32_t(id[it.second]), uint32_t(graphs.size()) });
+			graphs.insert(graphs.end(), it.first.begin(), it.first.end());
+		}
+		std::stable_sort(records.begin(), records.end(),
+			[](const region_table::record& a, const region_table::record& b) { return a.key < b.key; });
+		std::vector<uint32_t> bucket(region_table::buckets + 1, 0);
+		for (const region_table::record& r : records) bucket[(r.key >> 48) + 1]++;
+		for (size_t i = 1; i < bucket.size(); i++) bucket[i] += bucket[i - 1];
+
+		region_table::header head;
+		std::memcpy(head.magic, region_table::magic(), 8);
+		head.max_size = max_size;
+		head.games = entries.size();
+		head.options = options.size();
+		head.records = records.size();
+		head.graphs = graphs.size();
+		std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char*>(&head), sizeof(head));
+		out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(records[0]));
+		out.write(reinterpret_cast<const char*>(graphs.data()), graphs.size() * sizeof(graphs[0]));
+		out.write(reinterpret_cast<const char*>(bucket.data()), bucket.size() * sizeof(bucket[0]));
+		out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(entries[0]));
+		out.write(reinterpret_cast<const char*>(options.data()), options.size() * sizeof(options[0]));
+		return bool(out);
+	}
+
+	size_t size() const { return memo.size(); }
+
+	/**
+	 * the signature of a region given by its empty cells and its adjacent blocks
+	 *
+	 * the value of a region only depends on the graph of its cells, where cells are linked to their
+	 * adjacent cells and to the blocks they are liberties of, so the signature hashes that graph
+	 * with the cells numbered in board order, taking the smallest graph over the 8 symmetries
+	 * swapping the colors negates the value, so the graph is also the smallest of both colorings,
+	 * and swapped tells whether the value of the table is the negative of the region
+	 * form is the graph: the number of cells and of blocks, the neighbors of each cell, and the
+	 * liberties and the color of each block, which the table compares on lookup
+	 * the region should have at most region_table::max_region cells
+	 */
+	static uint64_t signature(bitboard::bits region, bitboard::bits black, bitboard::bits white,
+			bool* swapped = nullptr, region_table::graph_type* form = nullptr) {
+		region_table::graph_type normal = graph_of(region, black, white), reverse = graph_of(region, white, black);
+		if (swapped) *swapped = reverse < normal;
+		const region_table::graph_type& best = std::min(normal, reverse);
+		if (form) *form = best;
+		return hash(best);
+	}
+
+	/**
+	 * the value with the roles of black and white exchanged
+	 */
+	game negate(game g) {
+		if (g == zero) return g;
+		auto it = negative.find(g);
+		if (it != negative.end()) return it->second;
+		std::vector<game> left, right;
+		for (size_t i = 0; i < forms[g].right.size(); i++) left.push_back(negate(forms[g].right[i]));
+		for (size_t i = 0; i < forms[g].left.size(); i++) right.push_back(negate(forms[g].left[i]));
+		std::sort(left.begin(), left.end());
+		std::sort(right.begin(), right.end());
+		game n = intern(left, right);
+		negative[g] = n;
+		negative[n] = g;
+		return n;
+	}
+
+protected:
+	static region_table::graph_type graph_of(bitboard::bits region, bitboard::bits black, bitboard::bits white) {
+		bitboard::bits libs[bitboard::cells];
+		int n = 0;
+		bitboard::bits stones[2] = { black, white };
+		for (int c = 0; c < 2; c++) {
+			for (bitboard::bits rest = stones[c]; rest; n++) {
+				bitboard::bits blk = bitboard::block(rest & -rest, stones[c]);
+				libs[n] = (bitboard::neighbors(blk) & region) << 1 | c;
+				rest &= ~blk;
+			}
+		}
+		const int size = bitboard::count(region);
+		region_table::graph_type best, form(1 + size + n);
+		form[0] = uint64_t(size) | uint64_t(n) << 8;
+		for (int t = 0; t < 8; t++) {
+			const int* sym = symmetry(t);
+			bitboard::bits image = 0;
+			for (bitboard::bits rest = region; rest; rest &= rest - 1) image |= bitboard::bit(sym[bitboard::lowest(rest)]);
+			int local[bitboard::cells];
+			for (bitboard::bits rest = region; rest; rest &= rest - 1) {
+				int i = bitboard::lowest(rest);
+				local[i] = bitboard::count(image & (bitboard::bit(sym[i]) - 1));
+			}
+			auto mask = [&](bitboard::bits b) -> uint64_t {
+				uint64_t m = 0;
+				for (; b; b &= b - 1) m |= 1ull << local[bitboard::lowest(b)];
+				return m;
+			};
+			uint64_t* cells = &form[1];
+			uint64_t* blocks = &form[1 + size];
+			for (bitboard::bits rest = region; rest; rest &= rest - 1) {
+				int i = bitboard::lowest(rest);
+				cells[local[i]] = mask(bitboard::neighbors(bitboard::bit(i)) & region);
+			}
+			for (int k = 0; k < n; k++) blocks[k] = (mask(libs[k] >> 1) << 1) | uint64_t(libs[k] & 1);
+			std::sort(blocks, blocks + n);
+			if (t == 0 || form < best) best = form;
+		}
+		return best;
+	}
+
+	static uint64_t hash(const region_table::graph_type& form) {
+		uint64_t h = mix(form.size());
+		for (uint64_t w : form) h = mix(h ^ w);
+		return h;
+	}
+
+public:
+	game value_of_parts(const bitboard& b, bitboard::bits mask) {
+		game total = zero;
+		for (bitboard::bits part : b.regions(mask)) total = add(total, value(b, part));
+		return total;
+	}
+
+protected:
+	/**
+	 * the cell index mapping of the t-th of the 8 symmetries of the board
+	 */
+	static const int* symmetry(int t) {
+		struct table {
+			int sym[8][bitboard::cells];
+			table() {
+				for (int s = 0; s < 8; s++) {
+					for (int i = 0; i < bitboard::cells; i++) {
+						board::point p(i);
+						int x = (s & 1) ? board::size_x - 1 - p.x : p.x, y = (s & 2) ? board::size_y - 1 - p.y : p.y;
+						if (s & 4) std::swap(x, y);
+						sym[s][i] = board::point(x, y).i;
+					}
+				}
+			}
+		};
+		static const table t8;
+		return t8.sym[t];
+	}
+
+	static uint64_t mix(uint64_t x) {
+		x += 0x9e3779b97f4a7c15ull;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+		return x ^ (x >> 31);
+	}
+
+	/**
+	 * the game of the table with the given id, interned into this solver
+	 */
+	game translate(int id) {
+		if (loaded[id] != -1) return loaded[id];
+		const region_table::entry& e = table->game(id);
+		const uint32_t* opts = table->options(id);
+		std::vector<game> left, right;
+		for (int i = 0; i < e.left; i++) left.push_back(translate(opts[i]));
+		for (int i = 0; i < e.right; i++) right.push_back(translate(opts[e.left + i]));
+		std::sort(left.begin(), left.end());
+		std::sort(right.begin(), right.end());
+		return loaded[id] = intern(left, right);
+	}
+
+	/**
+	 * number g and its options in post-order for writing a table
+	 */
+	void number(game g, std::vector<int>& id, std::vector<region_table::entry>& entries, std::vector<uint32_t>& options) {
+		if (id[g] != -1) return;
+		const std::vector<game> left = forms[g].left, right = forms[g].right;
+		for (game o : left) number(o, id, entries, options);
+		for (game o : right) number(o, id, entries, options);
+		entries.push_back({ uint32_t(options.size()), uint16_t(left.size()), uint16_t(right.size()) });
+		for (game o : left) options.push_back(id[o]);
+		for (game o : right) options.push_back(id[o]);
+		id[g] = entries.size() - 1;
+	}
+
+	/**
+	 * remove dominated options and duplicates, keep the maximal left and the minimal right options
+	 */
+	void prune(std::vector<game>& opts, bool left) {
+		std::sort(opts.begin(), opts.end());
+		opts.erase(std::unique(opts.begin(), opts.end()), opts.end());
+		std::vector<game> keep;
+		for (size_t i = 0; i < opts.size(); i++) {
+			bool dominated = false;
+			for (size_t j = 0; !dominated && j < opts.size(); j++)
+				if (i != j) dominated = left ? le(opts[i], opts[j]) && (j < i || !le(opts[j], opts[i]))
+				                             : le(opts[j], opts[i]) && (j < i || !le(opts[i], opts[j]));
+			if (!dominated) keep.push_back(opts[i]);
+		}
+		opts.swap(keep);
+	}
+
+	game intern(const std::vector<game>& left, const std::vector<game>& right) {
+		auto key = std::make_pair(left, right);
+		auto it = index.find(key);
+		if (it != index.end()) return it->second;
+		forms.push_back({ left, right });
+		index[key] = forms.size() - 1;
+		return forms.size() - 1;
+	}
+
+	struct form {
+		std::vector<game> left, right;
+	};
+
+	struct region_key {
+		bitboard::bits region, black, white;
+		bool operator ==(const region_key& k) const {
+			return region == k.region && black == k.black && white == k.white;
+		}
+	};
+	struct region_hash {
+		size_t operator ()(const region_key& k) const {
+			bitboard::bits h = k.region * 0x9e3779b97f4a7c15ull ^ k.black * 0xc2b2ae3d27d4eb4full ^ k.white * 0x165667b19e3779f9ull;
+			return size_t(h ^ (h >> 64));
+		}
+	};
+
+	game zero;
+	std::vector<form> forms;
+	std::map<std::pair<std::vector<game>, std::vector<game> >, game> index;
+	std::unordered_map<uint64_t, bool> order;
+	std::unordered_map<uint64_t, game> sums;
+	std::unordered_map<game, game> negative;
+	std::unordered_map<region_key, game, region_hash> memo;
+	std::shared_ptr<region_table> table;
+	std::vector<game> loaded;
+};
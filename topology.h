@@ -0,0 +1,269 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * topology.h: CPU topology detection and thread placement for the search workers
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <tuple>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <set>
+#include <chrono>
+#include <sched.h>
+
+/**
+ * the logical CPUs that the process may run on, with their cores, packages and NUMA nodes from sysfs
+ *
+ * the CPUs are those in both the online list and the affinity mask of the process, so that a container
+ * or a taskset is respected; without sysfs, every CPU is taken as a core of its own on node 0
+ */
+class cpu_topology {
+public:
+	struct cpu {
+		int id;
+		int core; // index of the physical core in cores()
+		int node;
+		int sibling; // index among the SMT siblings of the core
+	};
+
+	/**
+	 * detect the topology of the given CPUs, or of all usable CPUs if the list is empty
+	 */
+	cpu_topology(const std::vector<int>& only = {}) {
+		std::vector<int> ids = only.size() ? only : usable();
+		std::vector<std::pair<int, int> > keys; // (package, core id) of each physical core
+		for (int id : ids) {
+			std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(id) + "/topology/";
+			std::pair<int, int> key(read_int(dir + "physical_package_id", 0), read_int(dir + "core_id", id));
+			auto it = std::find(keys.begin(), keys.end(), key);
+			int core = it - keys.begin();
+			if (it == keys.end()) keys.push_back(key);
+			int sibling = 0;
+			for (const cpu& c : list) sibling += (c.core == core);
+			list.push_back({ id, core, 0, sibling });
+		}
+		for (int node = 0; node < 1024; node++) {
+			std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+			std::string text;
+			if (!(in >> text)) break;
+			for (int id : parse(text))
+				for (cpu& c : list) if (c.id == id) c.node = node;
+		}
+		core_num = keys.size();
+	}
+
+public:
+	const std::vector<cpu>& cpus() const { return list; }
+	int cores() const { return core_num; }
+	int nodes() const {
+		int n = 0;
+		for (const cpu& c : list) n = std::max(n, c.node + 1);
+		return n;
+	}
+
+	/**
+	 * the CPU ids in the order that the threads are placed
+	 *
+	 * compact fills the SMT siblings of a core before the next core, and the cores of a node before the next node,
+	 * so that the threads share caches; spread takes one sibling of every core first, alternating between the
+	 * nodes, so that the threads share as little as possible
+	 */
+	std::vector<int> order(const std::string& policy) const {
+		std::vector<cpu> sorted = list;
+		if (policy == "spread") {
+			std::vector<std::vector<int> > node_cores(nodes());
+			for (const cpu& c : list) {
+				std::vector<int>& cores = node_cores[c.node];
+				if (std::find(cores.begin(), cores.end(), c.core) == cores.end()) cores.push_back(c.core);
+			}
+			auto rank = [&](const cpu& c) { // the rank of the core within its node
+				const std::vector<int>& cores = node_cores[c.node];
+				return int(std::find(cores.begin(), cores.end(), c.core) - cores.begin());
+			};
+			std::stable_sort(sorted.begin(), sorted.end(), [&](const cpu& a, const cpu& b) {
+				return std::make_tuple(a.sibling, rank(a), a.node) < std::make_tuple(b.sibling, rank(b), b.node);
+			});
+		} else {
+			std::stable_sort(sorted.begin(), sorted.end(), [](const cpu& a, const cpu& b) {
+				return std::make_tuple(a.node, a.core, a.sibling) < std::make_tuple(b.node, b.core, b.sibling);
+			});
+		}
+		std::vector<int> ids;
+		for (const cpu& c : sorted) ids.push_back(c.id);
+		return ids;
+	}
+
+	/**
+	 * split the cores into k groups of adjacent cores, as even as possible, and return the CPU ids of each group,
+	 * which share cores only if there are fewer cores than groups
+	 */
+	std::vector<std::vector<int> > partition(int k) const {
+		std::vector<int> compact = order("compact");
+		std::vector<int> core_order;
+		for (int id : compact) {
+			int core = find(id).core;
+			if (std::find(core_order.begin(), core_order.end(), core) == core_order.end()) core_order.push_back(core);
+		}
+		std::vector<std::vector<int> > groups(k);
+		if (!core_num) return groups;
+		for (int g = 0; g < k; g++) {
+			int begin = core_num >= k ? g * core_num / k : g % core_num;
+			int end = core_num >= k ? (g + 1) * core_num / k : begin + 1;
+			for (int id : compact) {
+				int core = std::find(core_order.begin(), core_order.end(), find(id).core) - core_order.begin();
+				if (core >= begin && core < end) groups[g].push_back(id);
+			}
+		}
+		return groups;
+	}
+
+public:
+	/**
+	 * bind the calling thread to the given CPUs, return false if the system refuses
+	 */
+	static bool bind(const std::vector<int>& ids) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int id : ids) if (id >= 0 && id < CPU_SETSIZE) CPU_SET(id, &set);
+		return sched_setaffinity(0, sizeof(set), &set) == 0;
+	}
+	static bool pin(int id) { return bind({ id }); }
+
+	/**
+	 * bind the calling thread to the given CPUs, if any, for the lifetime of the binding, and then give it back
+	 * the CPUs it had before, so that a thread that runs other work after a search is not left pinned
+	 */
+	class binding {
+	public:
+		binding(const std::vector<int>& ids) : saved(false) {
+			if (ids.empty()) return;
+			saved = sched_getaffinity(0, sizeof(previous), &previous) == 0;
+			bind(ids);
+		}
+		binding(const binding&) = delete;
+		binding& operator =(const binding&) = delete;
+		~binding() {
+			if (saved) sched_setaffinity(0, sizeof(previous), &previous);
+		}
+
+	private:
+		cpu_set_t previous;
+		bool saved;
+	};
+
+	/**
+	 * parse a CPU list such as "0-3,8,10-11"
+	 */
+	static std::vector<int> parse(const std::string& text) {
+		std::vector<int> ids;
+		std::stringstream ss(text);
+		for (std::string range; std::getline(ss, range, ','); ) {
+			if (range.empty()) continue;
+			size_t dash = range.find('-');
+			int first = std::stoi(range.substr(0, dash));
+			int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+			for (int id = first; id <= last; id++) ids.push_back(id);
+		}
+		return ids;
+	}
+
+	static std::string format(const std::vector<int>& ids) {
+		std::string text;
+		for (int id : ids) text += (text.size() ? "," : "") + std::to_string(id);
+		return text;
+	}
+
+private:
+	const cpu& find(int id) const {
+		return *std::find_if(list.begin(), list.end(), [id](const cpu& c) { return c.id == id; });
+	}
+
+	static std::vector<int> usable() {
+		std::vector<int> ids;
+		std::ifstream in("/sys/devices/system/cpu/online");
+		std::string text;
+		if (in >> text) ids = parse(text);
+		else for (unsigned id = 0; id < std::max(1u, std::thread::hardware_concurrency()); id++) ids.push_back(id);
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+			ids.erase(std::remove_if(ids.begin(), ids.end(), [&](int id) { return !CPU_ISSET(id, &set); }), ids.end());
+		}
+		return ids;
+	}
+
+	static int read_int(const std::string& path, int fallback) {
+		std::ifstream in(path);
+		int value;
+		return (in >> value) ? value : fallback;
+	}
+
+	std::vector<cpu> list;
+	int core_num;
+};
+
+/**
+ * the search threads of the process, shared by the players of all sessions of a GTP server, see --pool
+ *
+ * a search takes as many threads as it runs before it starts and gives them back when it ends; the searches
+ * that wait are served by the earliest deadline on the clocks of their games, i.e., by the time they started to
+ * wait minus the thinking time their players have spent in the game, so that a game that has used more of its
+ * clock goes first, while a search that waits long enough is served before any search that comes later
+ * the scheduler admits every search at once until it is given a number of threads
+ */
+class search_scheduler {
+public:
+	static search_scheduler& global() {
+		static search_scheduler scheduler;
+		return scheduler;
+	}
+
+	void configure(int threads) {
+		std::lock_guard<std::mutex> guard(lock);
+		capacity = threads;
+		ready.notify_all();
+	}
+
+	/**
+	 * wait for n threads, at most all of them, for a game that has spent the given seconds, and return how many are taken
+	 */
+	int acquire(int n, double spent) {
+		std::unique_lock<std::mutex> guard(lock);
+		if (capacity <= 0) return 0;
+		n = std::min(n, capacity);
+		double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		auto ticket = waiting.emplace(now - spent, serial++).first;
+		ready.wait(guard, [&]() { return waiting.begin() == ticket && used + n <= capacity; });
+		waiting.erase(ticket);
+		used += n;
+		ready.notify_all();
+		return n;
+	}
+
+	void release(int n) {
+		if (n == 0) return;
+		std::lock_guard<std::mutex> guard(lock);
+		used -= n;
+		ready.notify_all();
+	}
+
+private:
+	search_scheduler() : capacity(0), used(0), serial(0) {}
+
+	std::mutex lock;
+	std::condition_variable ready;
+	std::set<std::pair<double, long> > waiting;
+	int capacity;
+	int used;
+	long serial;
+};
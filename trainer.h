@@ -0,0 +1,182 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * trainer.h: Training of the policy and value network on a packed dataset
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <chrono>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <omp.h>
+#include "network.h"
+#include "dataset.h"
+
+/**
+ * stochastic gradient descent with momentum on the network of weights=, over the positions of data=
+ *
+ * the arguments are given as key=value pairs, like those of the players:
+ * data= the dataset made by --export, see dataset
+ * weights= the network file, which is trained further if it exists, and written after every epoch
+ * filters= and layers= the size of a new network, epochs= the passes over the data, batch= the positions
+ * in a step, rate= the learning rate, momentum=, decay= the weight decay, value= the weight of the value loss,
+ * shuffle= the positions in the shuffle buffer, seed=, and thread= the threads, one for each CPU by default
+ *
+ * the records are read in file order through the mapped file, and every position of a step is taken from
+ * a random slot of the shuffle buffer, which is refilled by the next record, in a random orientation
+ * each step splits the batch among the threads, each with its own workspace and gradients, and the
+ * gradients are summed over the threads, a slice of the parameters for each thread, before the update
+ */
+class trainer {
+public:
+	trainer(const std::string& args = "") {
+		std::stringstream ss(args);
+		for (std::string pair; ss >> pair; ) meta[pair.substr(0, pair.find('='))] = pair.substr(pair.find('=') + 1);
+		data_path = option("data", "");
+		weights_path = option("weights", "weights.bin");
+		epochs = std::stoi(option("epochs", "1"));
+		batch = std::max(1, std::stoi(option("batch", "256")));
+		rate = std::stod(option("rate", "0.01"));
+		momentum = std::stod(option("momentum", "0.9"));
+		decay = std::stod(option("decay", "0.0001"));
+		value_weight = std::stod(option("value", "1"));
+		shuffle = std::max(1, std::stoi(option("shuffle", "16384")));
+		threads = std::stoi(option("thread", std::to_string(omp_get_num_procs())));
+		engine.seed(std::stoul(option("seed", "1")));
+		if (!std::ifstream(weights_path).good())
+			net = network(std::stoi(option("filters", "32")), std::stoi(option("layers", "4")), engine());
+		else if (!net.load(weights_path))
+			weights_path.clear(); // not a network, which is left as it is
+	}
+
+	/**
+	 * train for epochs= passes, report the mean losses of every epoch on out, and return false if the data
+	 * cannot be opened or the weights cannot be written
+	 */
+	bool run(std::ostream& out) {
+		if (weights_path.empty()) return false;
+		if (!data.open(data_path)) {
+			std::cerr << "cannot open dataset " << data_path << std::endl;
+			return false;
+		}
+		const size_t size = network::cells * network::planes;
+		const int parts = std::max(1, std::min(threads, batch));
+		std::vector<network::workspace> work(parts);
+		std::vector<std::vector<float> > grads(parts, std::vector<float>(net.params().size()));
+		std::vector<float> velocity(net.params().size(), 0);
+		std::vector<float> input(batch * size), policy(batch * network::cells), value(batch);
+		std::vector<std::pair<size_t, int> > picks(batch);
+		std::vector<std::pair<double, double> > losses(parts);
+
+		for (int epoch = 0; epoch < epochs; epoch++) {
+			std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+			const size_t steps = data.records() / batch;
+			double policy_loss = 0, value_loss = 0;
+			fill_buffer();
+			for (size_t step = 0; step < steps; step++) {
+				for (std::pair<size_t, int>& pick : picks) pick = draw();
+
+				// the slices are dealt to the threads granted, which may be fewer than parts
+				#pragma omp parallel num_threads(parts)
+				{
+					const int id = omp_get_thread_num(), team = omp_get_num_threads();
+					for (int t = id; t < parts; t += team) {
+						const int first = batch * t / parts, last = batch * (t + 1) / parts, n = last - first;
+						dataset::sample s;
+						for (int i = first; i < last; i++) {
+							data.read(picks[i].first, picks[i].second, s);
+							network::features(s.state, &input[i * size]);
+							std::copy(s.policy, s.policy + network::cells, &policy[i * network::cells]);
+							value[i] = s.value;
+						}
+						std::fill(grads[t].begin(), grads[t].end(), 0.0f);
+						net.forward(work[t], &input[first * size], n);
+						losses[t] = net.backward(work[t], &input[first * size], &policy[first * network::cells], &value[first], grads[t], value_weight);
+					}
+					#pragma omp barrier
+					for (int t = id; t < parts; t += team) update(grads, velocity, t, parts);
+				}
+				for (const std::pair<double, double>& loss : losses) {
+					policy_loss += loss.first;
+					value_loss += loss.second;
+				}
+			}
+			if (!net.save(weights_path)) {
+				std::cerr << "cannot write network " << weights_path << std::endl;
+				return false;
+			}
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+			size_t samples = std::max<size_t>(steps * batch, 1);
+			out << "epoch " << epoch + 1 << ": policy loss = " << std::fixed << std::setprecision(4) << policy_loss / samples
+				<< ", value loss = " << value_loss / samples << ", " << std::setprecision(0) << samples / seconds << " positions/s"
+				<< std::defaultfloat << std::endl;
+		}
+		return true;
+	}
+
+private:
+	std::string option(const std::string& key, const std::string& value) const {
+		auto it = meta.find(key);
+		return it != meta.end() ? it->second : value;
+	}
+
+	/**
+	 * restart the records from the beginning of the file, with the shuffle buffer full of the first of them
+	 */
+	void fill_buffer() {
+		buffer.clear();
+		for (next = 0; next < data.records() && buffer.size() < size_t(shuffle); next++) buffer.push_back(next);
+	}
+
+	/**
+	 * take a record from a random slot of the shuffle buffer and put the next record there, with an orientation
+	 */
+	std::pair<size_t, int> draw() {
+		std::uniform_int_distribution<size_t> slot(0, buffer.size() - 1);
+		std::uniform_int_distribution<int> orientation(0, dataset::orientations - 1);
+		size_t i = slot(engine);
+		std::pair<size_t, int> pick(buffer[i], orientation(engine));
+		if (next < data.records()) {
+			buffer[i] = next++;
+		} else { // the file is used up for this epoch, so that the buffer shrinks
+			buffer[i] = buffer.back();
+			buffer.pop_back();
+		}
+		return pick;
+	}
+
+	/**
+	 * sum the gradients of a slice of the parameters over the threads, and take the step of momentum there
+	 */
+	void update(std::vector<std::vector<float> >& grads, std::vector<float>& velocity, int t, int parts) {
+		std::vector<float>& param = net.params();
+		const size_t first = param.size() * t / parts, last = param.size() * (t + 1) / parts;
+		const float scale = 1.0f / batch;
+		for (size_t i = first; i < last; i++) {
+			float g = 0;
+			for (int p = 0; p < parts; p++) g += grads[p][i];
+			velocity[i] = momentum * velocity[i] + g * scale + decay * param[i];
+			param[i] -= rate * velocity[i];
+		}
+	}
+
+	std::map<std::string, std::string> meta;
+	std::string data_path, weights_path;
+	int epochs, batch, shuffle, threads;
+	float rate, momentum, decay, value_weight;
+	std::default_random_engine engine;
+	network net;
+	dataset data;
+	std::vector<size_t> buffer;
+	size_t next = 0;
+};